@@ -44,6 +44,7 @@
 #define I2C_FREQ_DAC (400000) // Hz
 
 #define I2C_ADDRESS_DAC (0x60)
+// #define PIN_DAC_LDAC () // Optional GPIO driving the MCP4728 LDAC pin(s). When defined, power updates of every channel are latched at once.
 #define I2C_ADDRESS_POT (0x2F)
 
 // -------- UART --------
@@ -66,6 +67,10 @@
 
 // -------- Channels --------
 
+// Each channel needs a PIN_CHn_GA/GB gate pin pair and a DAC address/channel (4 channels per MCP4728).
+// Channels 1-4 run on pio0, channels 5-8 on pio1. SW32 has 4 channels, boards with more define PIN_CHn_GA/GB and CHn_DAC_ADDR/CH for each.
+#define CHANNEL_COUNT (4)
+
 // -------- Channel Defaults --------
 
 #define CH_CAL_THRESHOLD_OK (0.015f)
@@ -75,21 +80,25 @@
 // -------- Channel 1 --------
 #define PIN_CH1_GA (4)
 #define PIN_CH1_GB (5)
+#define CH1_DAC_ADDR (I2C_ADDRESS_DAC)
 #define CH1_DAC_CH (0)
 
 // -------- Channel 2 --------
 #define PIN_CH2_GA (0)
 #define PIN_CH2_GB (1)
+#define CH2_DAC_ADDR (I2C_ADDRESS_DAC)
 #define CH2_DAC_CH (1)
 
 // -------- Channel 3 --------
 #define PIN_CH3_GA (2)
 #define PIN_CH3_GB (3)
+#define CH3_DAC_ADDR (I2C_ADDRESS_DAC)
 #define CH3_DAC_CH (2)
 
 // -------- Channel 4 --------
 #define PIN_CH4_GA (6)
 #define PIN_CH4_GB (7)
+#define CH4_DAC_ADDR (I2C_ADDRESS_DAC)
 #define CH4_DAC_CH (3)
 
 // ---------------------------
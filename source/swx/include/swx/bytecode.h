@@ -0,0 +1,152 @@
+/*
+ * swx
+ * Copyright (C) 2024 saawsm
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BYTECODE_H
+#define _BYTECODE_H
+
+#include <stdint.h>
+
+#define VM_PROGRAM_SIZE (1024) // Size of the shared program memory in bytes.
+#define VM_THREADS (4)         // Number of routines that can run concurrently.
+#define VM_REGISTERS (8)       // Number of 16-bit registers per thread.
+
+#define VM_TICK_PERIOD_US (1000) // Interpreter tick period, WAIT and RAMP durations are rounded to ticks.
+#define VM_TICK_BUDGET (32)      // Maximum instructions executed per thread per tick.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bytecode instructions. Each instruction is a single opcode byte followed by its operands.
+// Multi-byte operands are big-endian. Registers are addressed by index (r = 0..VM_REGISTERS-1), addresses are byte offsets into program memory.
+// Arithmetic saturates to 0..UINT16_MAX. Program memory is zero filled, so running off the end of a routine halts.
+// Channel mask operands are 8-bit (LSB=channel 1), so programs address channels 1-8. That covers every channel, since a controller drives at
+// most 8 (one per PIO state machine). Protocol channel masks are 16-bit only to leave room for chained boards, which programs can't address.
+typedef enum {
+   /// Stop the thread.
+   /// Format: <none>
+   VM_OP_HALT = 0,
+
+   /// Do nothing.
+   /// Format: <none>
+   VM_OP_NOP,
+
+   /// Load an immediate value into a register.
+   /// Format: [r:8] [value:16]
+   VM_OP_LDI,
+
+   /// Copy register rs into register rd.
+   /// Format: [rd:8] [rs:8]
+   VM_OP_MOV,
+
+   /// rd = rd + rs
+   /// Format: [rd:8] [rs:8]
+   VM_OP_ADD,
+
+   /// rd = rd - rs
+   /// Format: [rd:8] [rs:8]
+   VM_OP_SUB,
+
+   /// r = r + value
+   /// Format: [r:8] [value:16]
+   VM_OP_ADDI,
+
+   /// r = r - value
+   /// Format: [r:8] [value:16]
+   VM_OP_SUBI,
+
+   /// Jump to address.
+   /// Format: [addr:16]
+   VM_OP_JMP,
+
+   /// Jump to address if register is zero.
+   /// Format: [r:8] [addr:16]
+   VM_OP_JZ,
+
+   /// Jump to address if register is not zero.
+   /// Format: [r:8] [addr:16]
+   VM_OP_JNZ,
+
+   /// Jump to address if register ra is less than register rb.
+   /// Format: [ra:8] [rb:8] [addr:16]
+   VM_OP_JLT,
+
+   /// Decrement register, then jump to address if the register is not zero. Used for loops.
+   /// Format: [r:8] [addr:16]
+   VM_OP_DJNZ,
+
+   /// Jump to address if the masked trigger inputs equal state. See MSG_ID_TRIGGER_STATE for bit order.
+   /// Format: [mask:8] [state:8] [addr:16]
+   VM_OP_JTRIG,
+
+   /// Jump to address if the audio amplitude (fraction of UINT16_MAX) of the analog channel is at least register r. See analog_channel_t.
+   /// Format: [src:8] [r:8] [addr:16]
+   VM_OP_JAUDIO,
+
+   /// Load the audio amplitude (fraction of UINT16_MAX) of the analog channel into a register. See analog_channel_t.
+   /// Format: [r:8] [src:8]
+   VM_OP_AUDIO,
+
+   /// Suspend the thread for a duration.
+   /// Format: [duration_ms:16]
+   VM_OP_WAIT,
+
+   /// Suspend the thread for a duration (milliseconds) held in a register.
+   /// Format: [r:8]
+   VM_OP_WAITR,
+
+   /// Set a parameter target on one or more channels to the value of a register. See param_t and target_t.
+   /// Format: [ch_mask:8] [param:8] [target:8] [r:8]
+   VM_OP_SETP,
+
+   /// Load a parameter target of a channel into a register. See param_t and target_t.
+   /// Format: [r:8] [ch_index:8] [param:8] [target:8]
+   VM_OP_GETP,
+
+   /// Linearly ramp the parameter TARGET_VALUE on one or more channels to the value of a register. The thread is suspended until the ramp completes.
+   /// Same as a MSG_ID_CH_PARAM_RAMP ramp, the value is limited between TARGET_MIN and TARGET_MAX and a later SETP of the target stops the ramp.
+   /// Format: [ch_mask:8] [param:8] [r:8] [duration_ms:16]
+   VM_OP_RAMP,
+
+   /// Enable pulse generation on one or more channels.
+   /// Format: [ch_mask:8]
+   VM_OP_ENABLE,
+
+   /// Disable pulse generation on one or more channels.
+   /// Format: [ch_mask:8]
+   VM_OP_DISABLE,
+
+   /// Execute each action between the start and end index (exclusive).
+   /// Format: [a_start_index:8] [a_end_index:8]
+   VM_OP_EXECUTE,
+
+   TOTAL_VM_OPS, // Number of opcodes in enum.
+} vm_op_t;
+
+typedef enum {
+   VM_STATE_STOPPED = 0, // Thread is not running.
+   VM_STATE_RUNNING,     // Thread is executing instructions.
+   VM_STATE_WAITING,     // Thread is suspended by WAIT/WAITR.
+   VM_STATE_RAMPING,     // Thread is suspended by RAMP.
+   VM_STATE_FAULT,       // Thread stopped due to an invalid instruction or operand.
+} vm_state_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _BYTECODE_H
@@ -18,14 +18,27 @@
 #ifndef _CHANNEL_H
 #define _CHANNEL_H
 
+#include <assert.h>
 #include <stdint.h>
 
+// Number of output channels, boards with chained output stages override this. Channels are spread over the PIO state machines (4 per PIO block).
+#ifndef CHANNEL_COUNT
 #define CHANNEL_COUNT (4)
+#endif
+
+#define MAX_CHANNEL_COUNT (16) // Limited by the width of ch_mask_t
+
+#define CHANNEL_MASK_ALL ((ch_mask_t)((1u << CHANNEL_COUNT) - 1)) // Mask with every configured channel set
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Bitmask of output channels (LSB=channel 1).
+typedef uint16_t ch_mask_t;
+
+static_assert(CHANNEL_COUNT > 0 && CHANNEL_COUNT <= MAX_CHANNEL_COUNT);
+
 typedef enum {
    CHANNEL_INVALID = 0,
    CHANNEL_FAULT,
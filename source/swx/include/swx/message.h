@@ -25,6 +25,8 @@
 // The message is encoded using COBS before being sent. The receiver will buffer data until it receives a 0x00 byte before COBS decoding it.
 // Debugging information (LOG_ macros) and COBS encoded messages share the same communication channel. This is achieved by having 0x00 byte appended
 // to any debugging messages, and assuming these messages will not contain the non-printable ASCII control character (STX 0x02 - MSG_FRAME_START).
+//
+// Multi-byte values are big-endian. Channel masks are always 16-bit (LSB=channel 0), bits above CHANNEL_COUNT are ignored.
 
 #define MSG_SIZE (1024)
 #define MSG_FRAME_SIZE (MSG_SIZE + 1 + ((MSG_SIZE + (254 - 1)) / 254))
@@ -56,6 +58,20 @@
 
 // ----------------------------------------------------------------------------------------
 
+// Requests the pulse lookahead horizon. Replies to sender with a MSG_ID_UPDATE_LOOKAHEAD message.
+//
+// Format: <none>
+#define MSG_ID_REQUEST_LOOKAHEAD (6)
+
+// Sets how far ahead pulses are queued for output, in microseconds (limited to 20 ms). Set zero to queue each pulse when due (default).
+// Queued pulses keep being output while the main loop is stalled (e.g. blocking writes). They are replanned when the pulse shape, frequency or
+// channel state changes, while swept parameters are sampled when a pulse is queued. Phase locked channels and audio pulses aren't queued ahead.
+//
+// Format: [lookahead_us_hi:8 lookahead_us_lo:8]
+#define MSG_ID_UPDATE_LOOKAHEAD (7)
+
+// ----------------------------------------------------------------------------------------
+
 // Shutdown device. Device will remain on until USB power is removed.
 //
 // Format: <none>
@@ -92,14 +108,50 @@
 
 // ----------------------------------------------------------------------------------------
 
+// Starts a configuration transaction. Until committed, configuration writes (channel audio, enable mask, parameters, sequencer, actions, ramp curve,
+// waveform) are staged in a copy of the live configuration instead of changing the generator. Requests read back the staged values.
+// Sending again while a transaction is open discards the staged writes.
+//
+// Format: <none>
+#define MSG_ID_CONFIG_BEGIN (15)
+
+// Commits the configuration transaction. The staged configuration replaces the live configuration in one step, between generator passes.
+// Runtime changes made to the live configuration since MSG_ID_CONFIG_BEGIN (e.g. parameter values from sweeps, fades and actions, enable bits,
+// and the sequencer index) are merged: fields written while staging take the staged value, the others keep their live value. Parameter targets
+// and the sequencer index (e.g. MSG_ID_RESET_SEQ_INDEX) count as written by any write, enable bits only when a write changed them.
+//
+// Format: <none>
+#define MSG_ID_CONFIG_COMMIT (16)
+
+// Aborts the configuration transaction, discarding staged writes.
+//
+// Format: <none>
+#define MSG_ID_CONFIG_ABORT (17)
+
+// ----------------------------------------------------------------------------------------
+
+// Requests the phase locked group for one or more output channels. Replies to sender with one or more MSG_ID_UPDATE_CH_GROUP messages.
+//
+// Format: [ch_mask:16]
+#define MSG_ID_REQUEST_CH_GROUP (18)
+
+// Sets the phase locked group for one or more output channels. Group members pulse from a shared timebase at the frequency of the
+// lowest index member, each offset by its phase. Phase is a fraction of the period out of UINT16_MAX (e.g. 21845 = 120 degrees).
+// Group is 1 to MAX_GROUPS, or zero to remove the channel from its group.
+//
+// Format: [ch_mask:16] [group:8] [phase_hi:8 phase_lo:8]
+#define MSG_ID_UPDATE_CH_GROUP (19)
+
+// ----------------------------------------------------------------------------------------
+
 // Requests the maximum power level for one or more output channels. Replies to sender with one or more MSG_ID_UPDATE_MAX_POWER messages.
 //
-// Format: [ch_mask:8]
+// Format: [ch_mask:16]
 #define MSG_ID_REQUEST_MAX_POWER (20)
 
 // Sets the maximum power level for one or more output channels. Value represents a percentage out of UINT16_MAX.
 //
-// Format: [ch_mask:8] [value_hi:8 value_lo:8]
+// Format: [ch_mask:16] [value_hi:8 value_lo:8]
 #define MSG_ID_UPDATE_MAX_POWER (21)
 
 // ----------------------------------------------------------------------------------------
@@ -111,20 +163,20 @@
 
 // Bitflags indicating what output channel is in "require zero" mode (LSB=channel 0).
 //
-// Format: [flags:8]
+// Format: [flags:16]
 #define MSG_ID_UPDATE_REQUIRE_ZERO (23)
 
 // ----------------------------------------------------------------------------------------
 
 // Requests the audio source/mode for one or more output channels. Replies to sender with one or more MSG_ID_UPDATE_CH_AUDIO messages.
 //
-// Format: [ch_mask:8]
+// Format: [ch_mask:16]
 #define MSG_ID_REQUEST_CH_AUDIO (24)
 
 // Sets the pulse generator audio source/mode for one or more output channels. Audio source represents an analog_channel_t. See AUDIO_MODE_FLAG* for modes.
 // Flags "require zero" if audio source changed.
 //
-// Format: [ch_mask:8] [gen_pulses:1 gen_power:1 audio_src:6]
+// Format: [ch_mask:16] [gen_pulses:1 gen_power:1 audio_src:6]
 #define MSG_ID_UPDATE_CH_AUDIO (25)
 
 // ----------------------------------------------------------------------------------------
@@ -149,37 +201,38 @@
 // Sets the pulse generator channel enable mask. Value is a bit mask representing output channels that are enabled (LSB=channel 0).
 // Flags "require zero" if enable changed.
 //
-// Format: [en_mask:8]
+// Format: [en_mask:16]
 #define MSG_ID_UPDATE_CH_EN_MASK (29)
 
 // ----------------------------------------------------------------------------------------
 
 // Requests a parameter target for one or more channels from the pulse generator. Replies to sender with one or more MSG_ID_UPDATE_CH_PARAM messages.
 //
-// Format: [ch_mask:8] [param:4 target:4]
+// Format: [ch_mask:16] [param:4 target:4]
 #define MSG_ID_REQUEST_CH_PARAM (30)
 
 // Sets a pulse generator parameter target for one or more channels.
 //
-// Format: [ch_mask:8] [param:4 target:4] [value_hi:8 value_lo:8]
+// Format: [ch_mask:16] [param:4 target:4] [value_hi:8 value_lo:8]
 #define MSG_ID_UPDATE_CH_PARAM (31)
 
-// Update internal parameter state for one or more channels. Updates are needed when a parameter is
-// auto cycling and changes to TARGET_MODE, RATE, MIN, or MAX occur. Use param 0xff to update all parameters for the given channel mask.
+// Update internal parameter state for one or more channels. Changes to TARGET_MODE, RATE, MIN, or MAX automatically update
+// the parameter before its next step, so this is only needed to force an immediate update.
+// Use param 0xff to update all parameters for the given channel mask.
 //
-// Format: [ch_mask:8] [param:8]
+// Format: [ch_mask:16] [param:8]
 #define MSG_ID_CH_PARAM_UPDATE (32)
 
 // ----------------------------------------------------------------------------------------
 
 // Requests output channel status for one or more channels. Replies to sender with one or more MSG_ID_CH_STATUS messages.
 //
-// Format: [ch_mask:8]
+// Format: [ch_mask:16]
 #define MSG_ID_REQUEST_CH_STATUS (33)
 
 // Output channel status for one channel (LSB=channel 0). Status represents a channel_status_t.
 //
-// Format: [ch_mask:8] [status:8]
+// Format: [ch_mask:16] [status:8]
 #define MSG_ID_CH_STATUS (34)
 
 // ----------------------------------------------------------------------------------------
@@ -191,7 +244,7 @@
 
 // Sets the sequencer sequence. (LSB=channel 0). If wrap is true, sequencer wrap count (MSG_ID_UPDATE_SEQ_COUNT) is set to specified count.
 //
-// Format: [wrap:8] [count:8] [mask:8 ...count]
+// Format: [wrap:8] [count:8] [mask:16 ...count]
 #define MSG_ID_UPDATE_SEQ (36)
 
 // Requests the current sequencer count. Replies to sender with a MSG_ID_UPDATE_SEQ_COUNT message.
@@ -227,9 +280,10 @@
 #define MSG_ID_REQUEST_ACTION (42)
 
 // Sets an action at the specified action slot index. See param_t, target_t and action_type_t.
-// Set type to ACTION_NONE or enabled to zero to disable.
+// Set type to ACTION_NONE or enabled to zero to disable. Ignored if an ACTION_EXECUTE action would create a cycle.
+// The trailing duration is optional (zero if omitted), and is only used by ACTION_RAMP_TO.
 //
-// Format: [a_index:8] [enabled:8] [type:8] [ch_mask:8] [param:8] [target:8] [value_hi:8 value_lo:8]
+// Format: [a_index:8] [enabled:8] [type:8] [ch_mask:16] [param:8] [target:8] [value_hi:8 value_lo:8] [duration_ms:16]
 #define MSG_ID_UPDATE_ACTION (43)
 
 // Runs all actions between start and end indices. End index is exclusive.
@@ -239,6 +293,29 @@
 
 // ----------------------------------------------------------------------------------------
 
+// Requests the power ramp curve for one or more output channels. Replies to sender with one or more MSG_ID_UPDATE_CH_RAMP_CURVE messages.
+//
+// Format: [ch_mask:16]
+#define MSG_ID_REQUEST_CH_RAMP_CURVE (45)
+
+// Sets the envelope shape used by the on/off power ramps for one or more output channels. See ramp_curve_t.
+//
+// Format: [ch_mask:16] [curve:8]
+#define MSG_ID_UPDATE_CH_RAMP_CURVE (46)
+
+// Requests the pulse waveform for one or more output channels. Replies to sender with one or more MSG_ID_UPDATE_CH_WAVEFORM messages.
+//
+// Format: [ch_mask:16]
+#define MSG_ID_REQUEST_CH_WAVEFORM (47)
+
+// Sets the pulse waveform for one or more output channels. See WAVEFORM_FLAG*
+// A zero negative width uses the pulse width (symmetric pulses). A burst count of zero or one generates single pulses.
+//
+// Format: [ch_mask:16] [flags:8] [neg_width_us:16] [gap_us:8] [burst_count:8] [burst_period_us:16]
+#define MSG_ID_UPDATE_CH_WAVEFORM (48)
+
+// ----------------------------------------------------------------------------------------
+
 // Requests a trigger at the specified trigger slot index. Responds with a MSG_ID_UPDATE_TRIGGER message.
 //
 // Format: [trig_index:8]
@@ -263,4 +340,191 @@
 // Format: [state_mask:8]
 #define MSG_ID_TRIGGER_STATE (53)
 
+// ----------------------------------------------------------------------------------------
+
+// Requests the deferred action timer wheel counters, optionally resetting them after replying. Responds with a MSG_ID_TIMER_STATS message.
+//
+// Format: [reset:8]
+#define MSG_ID_REQUEST_TIMER_STATS (54)
+
+// Deferred action timer wheel counters (delayed ACTION_ENABLE/DISABLE/TOGGLE). See timer_wheel_stats_t.
+//
+// Format: [capacity:8] [occupancy:8] [peak_occupancy:8] [overflows:32] [expired:32] [max_late_us:32]
+#define MSG_ID_TIMER_STATS (55)
+
+// ----------------------------------------------------------------------------------------
+
+// Requests the fractional frequency for one or more output channels. Replies to sender with one or more MSG_ID_UPDATE_CH_FREQ_FRAC messages.
+//
+// Format: [ch_mask:16]
+#define MSG_ID_REQUEST_CH_FREQ_FRAC (56)
+
+// Sets the fractional part of PARAM_FREQUENCY for one or more output channels, in 1/256 dHz units.
+//
+// Format: [ch_mask:16] [frac:8]
+#define MSG_ID_UPDATE_CH_FREQ_FRAC (57)
+
+// Requests the configured and measured pulse rate for one or more output channels. Replies to sender with one or more MSG_ID_CH_RATE messages.
+//
+// Format: [ch_mask:16]
+#define MSG_ID_REQUEST_CH_RATE (58)
+
+// Configured and measured pulse rate of an output channel. Frequencies are in dHz with 8 fractional bits, error is signed. See rate_stats_t.
+//
+// Format: [ch_mask:16] [freq:32] [measured_freq:32] [error_ppm:32] [resyncs:32]
+#define MSG_ID_CH_RATE (59)
+
+// ----------------------------------------------------------------------------------------
+
+// Writes bytecode into the VM program memory at the specified address. Stops all VM threads. See vm_op_t.
+//
+// Format: [addr:16] [bytes:n]
+#define MSG_ID_UPDATE_VM_PROGRAM (60)
+
+// Starts a VM thread at the specified program address. Thread registers are cleared.
+//
+// Format: [thread_index:8] [addr:16]
+#define MSG_ID_VM_START (61)
+
+// Stops one or more VM threads.
+//
+// Format: [thread_mask:8]
+#define MSG_ID_VM_STOP (62)
+
+// Requests the state of a VM thread. Responds with a MSG_ID_VM_STATE message.
+//
+// Format: [thread_index:8]
+#define MSG_ID_REQUEST_VM_STATE (63)
+
+// VM thread state. See vm_state_t.
+//
+// Format: [thread_index:8] [state:8] [pc:16] [reg:16]*VM_REGISTERS
+#define MSG_ID_VM_STATE (64)
+
+// ----------------------------------------------------------------------------------------
+
+// Requests a modulation route at the specified route index. Responds with a MSG_ID_UPDATE_MOD_ROUTE message.
+//
+// Format: [r_index:8]
+#define MSG_ID_REQUEST_MOD_ROUTE (65)
+
+// Sets a modulation route at the specified route index (up to MAX_MOD_ROUTES). See mod_source_t, param_t and target_t.
+// The source level (fraction of UINT16_MAX) is scaled by depth (signed fraction of INT16_MAX) and added to offset (fraction of UINT16_MAX).
+// Routes with the same destination are summed. For TARGET_VALUE, the sum is a fraction of the destination min to max range.
+// Set source to MOD_SOURCE_NONE to disable. Ignored if the source or destination is out of range.
+//
+// Format: [r_index:8] [source:8] [source_index:8] [source_param:8] [ch_mask:16] [param:8] [target:8] [offset_hi:8 offset_lo:8] [depth_hi:8 depth_lo:8]
+#define MSG_ID_UPDATE_MOD_ROUTE (66)
+
+// ----------------------------------------------------------------------------------------
+
+// Requests the power mode for one or more output channels. Replies to sender with one or more MSG_ID_UPDATE_CH_POWER_MODE messages.
+//
+// Format: [ch_mask:16]
+#define MSG_ID_REQUEST_CH_POWER_MODE (67)
+
+// Sets how output power is applied for one or more output channels. See power_mode_t.
+//
+// Format: [ch_mask:16] [mode:8]
+#define MSG_ID_UPDATE_CH_POWER_MODE (68)
+
+// Requests the width power table for one or more output channels. Replies to sender with one or more MSG_ID_UPDATE_CH_POWER_LUT messages.
+//
+// Format: [ch_mask:16]
+#define MSG_ID_REQUEST_CH_POWER_LUT (69)
+
+// Sets the width power table used by POWER_MODE_WIDTH for one or more output channels. Each entry is the pulse width multiplier (fraction of UINT16_MAX)
+// for evenly spaced power levels, from zero to full power.
+//
+// Format: [ch_mask:16] [width:16]*(POWER_LUT_SIZE+1)
+#define MSG_ID_UPDATE_CH_POWER_LUT (70)
+
+// ----------------------------------------------------------------------------------------
+
+// Requests a timeline step at the specified step index. Responds with a MSG_ID_UPDATE_TIMELINE_STEP message.
+//
+// Format: [s_index:8]
+#define MSG_ID_REQUEST_TIMELINE_STEP (71)
+
+// Sets a timeline step at the specified step index (up to MAX_TIMELINE_STEPS). Steps run in order for their duration, then wrap to the first step.
+// When a step starts, the enable mask (masked with MSG_ID_UPDATE_CH_EN_MASK) is applied and its scene entries (scene_start to scene_start + scene_count)
+// are set. A non-zero fade crossfades into the next step scene over the end of this step. Steps with zero duration are skipped. Restarts the timeline.
+//
+// Format: [s_index:8] [duration_ms:16] [fade_ms:16] [en_mask:16] [scene_start:8] [scene_count:8]
+#define MSG_ID_UPDATE_TIMELINE_STEP (72)
+
+// Requests a scene entry at the specified entry index. Responds with a MSG_ID_UPDATE_SCENE_ENTRY message.
+//
+// Format: [e_index:8]
+#define MSG_ID_REQUEST_SCENE_ENTRY (73)
+
+// Sets a scene entry at the specified entry index (up to MAX_SCENE_ENTRIES), a parameter target value set on one or more channels by timeline steps.
+// See param_t and target_t. Restarts the timeline.
+//
+// Format: [e_index:8] [ch_mask:16] [param:8] [target:8] [value_hi:8 value_lo:8]
+#define MSG_ID_UPDATE_SCENE_ENTRY (74)
+
+// Requests the timeline step count. Responds with a MSG_ID_UPDATE_TIMELINE_COUNT message.
+//
+// Format: <none>
+#define MSG_ID_REQUEST_TIMELINE_COUNT (75)
+
+// Sets the number of timeline steps run before wrapping, and restarts the timeline from the first step. The timeline replaces the sequencer
+// while enabled. Set zero to disable.
+//
+// Format: [count:8]
+#define MSG_ID_UPDATE_TIMELINE_COUNT (76)
+
+// ----------------------------------------------------------------------------------------
+
+// Linearly ramps a pulse generator parameter target for one or more channels from its current value to the value over the duration.
+// Interpolation runs on the device, replacing any running ramp of the same target. A MSG_ID_UPDATE_CH_PARAM write to the target stops the ramp.
+// TARGET_VALUE is limited between TARGET_MIN and TARGET_MAX. A zero duration sets the value immediately. While staging, the value is set without a ramp.
+//
+// Format: [ch_mask:16] [param:4 target:4] [value_hi:8 value_lo:8] [duration_ms:16]
+#define MSG_ID_CH_PARAM_RAMP (77)
+
+// ----------------------------------------------------------------------------------------
+
+// Requests a preview of the pulses, power, and waveform states of one or more output channels over the next window_ms, fast-forwarded from their
+// current state without affecting generation. Parameters are held at their current values. Replies to sender with one or more MSG_ID_CH_PREVIEW messages.
+//
+// Format: [ch_mask:16] [window_ms:16]
+#define MSG_ID_REQUEST_CH_PREVIEW (78)
+
+// Preview events of an output channel, in time order. Event times are microseconds from the request, see preview_event_type_t for types and values.
+// covered_us is shorter than the requested window if the event or step limit was reached (see PREVIEW_MAX_EVENTS and PREVIEW_MAX_STEPS).
+//
+// Format: [ch_mask:16] [covered_us:32] [count:8] [[time_us:32] [type:8] [value:16] ...count]
+#define MSG_ID_CH_PREVIEW (79)
+
+// ----------------------------------------------------------------------------------------
+
+// Requests a morph bank parameter target for one or more channels. Replies to sender with one or more MSG_ID_UPDATE_MORPH_BANK messages.
+//
+// Format: [bank:8] [ch_mask:16] [param:4 target:4]
+#define MSG_ID_REQUEST_MORPH_BANK (80)
+
+// Sets a morph bank parameter target for one or more channels. Bank 0 is A, bank 1 is B.
+//
+// Format: [bank:8] [ch_mask:16] [param:4 target:4] [value_hi:8 value_lo:8]
+#define MSG_ID_UPDATE_MORPH_BANK (81)
+
+// Copies every parameter target of every channel into a morph bank, so a configured program can be captured as bank A or B.
+//
+// Format: [bank:8]
+#define MSG_ID_MORPH_CAPTURE (82)
+
+// Requests the morph state. Replies to sender with a MSG_ID_UPDATE_MORPH message.
+//
+// Format: <none>
+#define MSG_ID_REQUEST_MORPH (83)
+
+// Sets the morph state. While enabled, channel parameter targets follow the banks, interpolated by the position (fraction of UINT16_MAX,
+// zero is bank A). TARGET_MODE and TARGET_ACTION_RANGE switch from bank A to bank B at the midpoint.
+// Only targets set (MSG_ID_UPDATE_MORPH_BANK) or captured (MSG_ID_MORPH_CAPTURE) in both banks follow the morph, the others keep their value.
+//
+// Format: [enabled:8] [position_hi:8 position_lo:8]
+#define MSG_ID_UPDATE_MORPH (84)
+
 #endif // _MESSAGE_H
\ No newline at end of file
@@ -23,6 +23,15 @@
 #define MAX_SEQUENCES (255)
 #define MAX_ACTIONS (255)
 #define MAX_TRIGGERS (64)
+#define MAX_MOD_ROUTES (16)
+#define MAX_TIMELINE_STEPS (64)
+#define MAX_SCENE_ENTRIES (128)
+
+#define POWER_LUT_BITS (4)
+#define POWER_LUT_SIZE (1 << POWER_LUT_BITS) // Number of segments in a channel width power table, see POWER_MODE_WIDTH.
+
+#define RAMP_TABLE_BITS (6)
+#define RAMP_TABLE_SIZE (1 << RAMP_TABLE_BITS) // Number of segments in a ramp envelope table, see ramp_curve_t.
 
 #ifdef __cplusplus
 extern "C" {
@@ -68,6 +77,7 @@ typedef enum {
 
    /// The cycling mode the parameter is using. Determines how the value resets when it reaches min/max.
    /// Provides bit flags (see TARGET_MODE_FLAG*), these act as hints for user menu behaviour/appearance of targets.
+   /// Upper byte contains the LFO skew (see TARGET_MODE_SKEW_SHIFT), lower byte contains the mode (see TARGET_MODE_MASK) and flags.
    TARGET_MODE,
 
    /// Execute actions between start/end indices when value reaches min/max. Lower byte contains end index, upper byte contains start index.
@@ -99,8 +109,26 @@ typedef enum {
    /// Ramp smoothly from maximum to minimum and then disable cycling.
    TARGET_MODE_DOWN,
 
+   /// LFO modes. Value follows a waveform between minimum and maximum, starting at minimum. Rate is the number of waveform cycles per second.
+   /// Actions run at the start of each cycle. Skew (signed) moves the waveform peak, e.g. -128 for a falling sawtooth, 0 for symmetric, 127 for a rising sawtooth.
+
+   /// Raised sine (cosine starting at minimum).
+   TARGET_MODE_SINE,
+
+   /// Triangle.
+   TARGET_MODE_TRIANGLE,
+
+   /// Square, minimum for the first half of the cycle and maximum for the second. Skew sets the duty cycle.
+   TARGET_MODE_SQUARE,
+
+   /// Smoothed random, glides to a new random value every cycle. Skew is ignored.
+   TARGET_MODE_RANDOM,
+
 } target_mode_t;
 
+#define TARGET_MODE_MASK (0x3f)    // Mode bits, see target_mode_t.
+#define TARGET_MODE_SKEW_SHIFT (8) // LFO skew bits (int8_t), see TARGET_MODE_SINE.
+
 #define TARGET_MODE_FLAG (3 << 6)          // Mask bits.
 #define TARGET_MODE_FLAG_HIDDEN (1 << 6)   // If set, param target should be hidden in user menus.
 #define TARGET_MODE_FLAG_READONLY (2 << 6) // If set, param target should be readonly in user menus.
@@ -127,14 +155,38 @@ typedef enum {
    ACTION_TOGGLE,
 
    /// Run another action list. Value contains index range for list. Upper byte is start index, lower byte is end index.
+   /// The list is inlined when compiled, actions that would create a cycle are rejected.
    ACTION_EXECUTE,
 
-   /// Update a parameter for one or more channels.
+   /// Update a parameter for one or more channels. Parameters update automatically when targets change, this forces an immediate update.
    ACTION_PARAM_UPDATE,
 
+   /// Linearly ramp a parameter target from its current value to the action value, over the action duration in milliseconds.
+   /// TARGET_VALUE is limited between TARGET_MIN and TARGET_MAX. Replaces any running ramp of the same parameter target.
+   ACTION_RAMP_TO,
+
    TOTAL_ACTION_TYPES, // Number of action types in enum.
 } action_type_t;
 
+// Modulation route sources. Each source is read as a level (fraction of UINT16_MAX).
+typedef enum {
+   MOD_SOURCE_NONE = 0,
+
+   /// Parameter value of a channel, as a fraction of its min to max range. Index is the channel, param is the source parameter.
+   MOD_SOURCE_PARAMETER,
+
+   /// Audio amplitude of an analog channel. Index is the analog channel, see analog_channel_t.
+   MOD_SOURCE_AUDIO,
+
+   /// Trigger input, UINT16_MAX when active otherwise zero. Index is the input bit, see MSG_ID_TRIGGER_STATE for bit order.
+   MOD_SOURCE_TRIGGER,
+
+   /// Maximum power level (e.g. front panel knob) of a channel. Index is the channel.
+   MOD_SOURCE_KNOB,
+
+   TOTAL_MOD_SOURCES, // Number of sources in enum.
+} mod_source_t;
+
 typedef enum {
    TRIGGER_OP_DDD = 0, // disabled
    TRIGGER_OP_OOO,     // t1 || t2 || t3 || t4
@@ -148,6 +200,37 @@ typedef enum {
    TOTAL_TRIGGER_OPS,
 } trigger_op_t;
 
+typedef enum {
+   /// Intensity changes at a constant rate.
+   RAMP_CURVE_LINEAR = 0,
+
+   /// Intensity changes slowly at first then quickly (perceptually even for fade-ins).
+   RAMP_CURVE_EXPONENTIAL,
+
+   /// Intensity eases in and out (smoothstep).
+   RAMP_CURVE_S_CURVE,
+
+   /// Intensity changes quickly at first then slowly.
+   RAMP_CURVE_LOGARITHMIC,
+
+   TOTAL_RAMP_CURVES, // Number of ramp curves in enum.
+} ramp_curve_t;
+
+typedef enum {
+   /// Output power is set by the DAC. DAC updates are rate limited by the I2C bus (~110us per channel).
+   POWER_MODE_DAC = 0,
+
+   /// The DAC holds the PARAM_POWER TARGET_MAX set-point, while the remaining power (ramps, sweeps, modulation, audio amplitude) scales the width
+   /// of each generated pulse through the channel width power table. Zero crossing audio pulses are not scaled.
+   POWER_MODE_WIDTH,
+
+   TOTAL_POWER_MODES, // Number of power modes in enum.
+} power_mode_t;
+
+#define WAVEFORM_FLAG_MONOPHASIC (1 << 0) // If set, pulses only have a positive phase (no negative phase or inter-phase gap).
+#define WAVEFORM_FLAG_ALTERNATE (1 << 1)  // If set, pulse polarity alternates every pulse (bursts included).
+#define WAVEFORM_FLAG_INVERT (1 << 2)     // If set, pulse polarity is inverted (negative phase first).
+
 #define AUDIO_MODE_FLAG (3 << 6)       // Mask bits.
 #define AUDIO_MODE_FLAG_POWER (1 << 6) // If set, audio processor will modulate power levels based on volume.
 #define AUDIO_MODE_FLAG_PULSE (2 << 6) // If set, audio processor will generate pulses for each zero crossing.
@@ -0,0 +1,101 @@
+/*
+ * swx
+ * Copyright (C) 2024 saawsm
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _PREVIEW_H
+#define _PREVIEW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "parameter.h"
+
+// Channel schedule preview. Fast-forwards a snapshot of a channel on a virtual clock, without touching generator or output state.
+// Only depends on the C standard library, these public headers, and src/util/pulse_math.h (which the generator also uses for the waveform
+// state, ramp envelope, width power, and pulse timebase), so src/preview.c can also be built on the host for offline preview.
+//
+// The preview only models the waveform states, ramp envelope, power mode, and pulse timebase of a single channel. It does not model:
+//  - Parameter sweeps and LFOs (TARGET_MODE), every parameter value is held for the whole window.
+//  - Modulation routes, fades and ramps, morphing, and VM threads, which also change parameter values.
+//  - The sequencer and timeline, which change the enable mask and parameters.
+//  - Actions, deferred or from sweeps reaching their ends.
+//  - Phase locked groups, the channel pulses from its own timebase.
+//  - Audio sources, pulse shape (e.g. WAVEFORM_FLAG_ALTERNATE), and output queue limits.
+
+#define PREVIEW_MAX_EVENTS (128) // Most events returned by a single preview
+#define PREVIEW_MAX_STEPS (4096) // Most simulation steps per preview, bounds the CPU time of long windows at high frequencies
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pulse generation "waveform" states, in the order they run. States with zero duration are skipped.
+typedef enum {
+   PREVIEW_STATE_ON_RAMP = 0, // Power ramps from zero to the power value, see PARAM_ON_RAMP_TIME.
+   PREVIEW_STATE_ON,          // Power is held, see PARAM_ON_TIME.
+   PREVIEW_STATE_OFF_RAMP,    // Power ramps from the power value to zero, see PARAM_OFF_RAMP_TIME.
+   PREVIEW_STATE_OFF,         // No pulses, see PARAM_OFF_TIME.
+
+   TOTAL_PREVIEW_STATES, // Number of states in enum.
+} preview_state_t;
+
+typedef enum {
+   /// The waveform state changed. Value is the new state, see preview_state_t.
+   PREVIEW_EVENT_STATE = 0,
+
+   /// The output power changed. Value is the power (fraction of UINT16_MAX), only sampled when a pulse is generated.
+   PREVIEW_EVENT_POWER,
+
+   /// A pulse (or burst of pulses) is generated. Value is the positive phase width in microseconds.
+   PREVIEW_EVENT_PULSE,
+
+   TOTAL_PREVIEW_EVENTS, // Number of event types in enum.
+} preview_event_type_t;
+
+typedef struct {
+   uint32_t time_us; // Offset from the start of the preview window.
+   uint8_t type;     // See preview_event_type_t.
+   uint16_t value;
+} preview_event_t;
+
+// The configuration and generator state a preview starts from. Parameter values are held for the whole window, see above for what isn't modeled.
+typedef struct {
+   uint32_t freq_q8;                             // Pulse frequency (dHz, Q8), zero if pulses are disabled.
+   uint32_t state_time_us[TOTAL_PREVIEW_STATES]; // Duration of each waveform state.
+   uint16_t power;                               // PARAM_POWER value (fraction of UINT16_MAX).
+   uint16_t power_max;                           // PARAM_POWER maximum, the DAC set-point for POWER_MODE_WIDTH.
+   uint16_t pulse_width;                         // PARAM_PULSE_WIDTH value in microseconds.
+   uint8_t power_mode;                           // See power_mode_t.
+   uint16_t ramp_table[RAMP_TABLE_SIZE + 1];     // Ramp envelope for the channel ramp curve (fraction of UINT16_MAX) at evenly spaced phases.
+   uint16_t power_lut[POWER_LUT_SIZE + 1];       // Channel width power table, see POWER_MODE_WIDTH.
+
+   bool enabled;              // True if the channel is generating pulses.
+   uint8_t state_index;       // The current waveform state, see preview_state_t.
+   uint32_t state_elapsed_us; // Time since the current state started.
+   uint32_t next_pulse_us;    // Time until the next pulse, from the channel pulse timebase.
+   uint32_t pulse_acc;        // Accumulated fractional microseconds of the pulse timebase (Q32).
+} preview_channel_t;
+
+// Fast-forward the channel over the window, writing at most max_events events in time order. Returns the number of events written.
+// covered_us is set to the length of the window that was simulated, which is shorter than the window if max_events or PREVIEW_MAX_STEPS was reached.
+size_t preview_run(const preview_channel_t* ch, uint32_t window_us, preview_event_t* events, size_t max_events, uint32_t* covered_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _PREVIEW_H
@@ -209,7 +209,10 @@ static inline void mmaba(uint16_t* samples, size_t count, buf_stats_t* stats) {
    if (level < 0)
       level = 0;
 
-   stats->amplitude = (float)level / ADC_ZERO_POINT;
+   if (level > ADC_ZERO_POINT)
+      level = ADC_ZERO_POINT;
+
+   stats->amplitude = ((uint32_t)level * UINT16_MAX) / ADC_ZERO_POINT;
 }
 
 bool fetch_analog_buffer(analog_channel_t channel, size_t* samples, uint16_t** buffer, uint32_t* capture_end_time_us, buf_stats_t* stats, bool update_stats) {
@@ -256,6 +259,16 @@ bool fetch_analog_buffer(analog_channel_t channel, size_t* samples, uint16_t** b
    }
 }
 
+uint16_t analog_amplitude(analog_channel_t channel) {
+   size_t samples;
+   uint16_t* buffer;
+   uint32_t capture_end_time_us;
+   buf_stats_t stats;
+
+   fetch_analog_buffer(channel, &samples, &buffer, &capture_end_time_us, &stats, true);
+   return stats.amplitude;
+}
+
 static inline uint32_t log2i(uint32_t n) {
    uint32_t level = 0;
    while (n >>= 1)
@@ -41,7 +41,7 @@ typedef struct {
    uint32_t max;
    uint32_t above;
    uint32_t below;
-   float amplitude;
+   uint16_t amplitude; // Peak level from the zero point, as a fraction of UINT16_MAX.
 } buf_stats_t;
 
 extern const uint32_t adc_capture_duration_us;
@@ -51,6 +51,9 @@ void analog_capture_init();
 
 bool fetch_analog_buffer(analog_channel_t channel, size_t* samples, uint16_t** buffer, uint32_t* capture_end_time_us, buf_stats_t* stats, bool update_stats);
 
+// Returns the peak level of the latest buffer captured for the channel, as a fraction of UINT16_MAX. See buf_stats_t.
+uint16_t analog_amplitude(analog_channel_t channel);
+
 void gain_preamp_set(uint8_t value);
 uint8_t gain_preamp_get();
 
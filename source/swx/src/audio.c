@@ -22,10 +22,12 @@
 #include "output.h"
 #include "analog_capture.h"
 
+#define AUDIO_NOISE_FLOOR (UINT16_MAX / 50) // ~2%
+
 static int32_t last_sample_values[CHANNEL_COUNT] = {0};
 static uint32_t last_process_times_us[CHANNEL_COUNT] = {0};
 
-float audio_process(analog_channel_t audio_src, bool gen_zcs, uint8_t ch_index, uint16_t pulse_width_us, uint32_t min_period_us, uint32_t* last_pulse_time_us) {
+uint16_t audio_process(analog_channel_t audio_src, bool gen_zcs, uint8_t ch_index, uint16_t pulse_width_us, uint32_t min_period_us, uint32_t* last_pulse_time_us) {
    size_t sample_count;
    uint16_t* sample_buffer;
    uint32_t capture_end_time_us = 0;
@@ -40,8 +42,8 @@ float audio_process(analog_channel_t audio_src, bool gen_zcs, uint8_t ch_index,
    last_process_times_us[ch_index] = capture_end_time_us;
 
    // Noise filter, ignore very weak signals.
-   if (stats.amplitude < 0.02f)
-      return 0.0f;
+   if (stats.amplitude < AUDIO_NOISE_FLOOR)
+      return 0;
 
    if (gen_zcs) {
       const uint32_t capture_start_time_us = capture_end_time_us - adc_capture_duration_us; // time when capture started
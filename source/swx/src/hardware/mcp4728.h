@@ -24,6 +24,7 @@
 
 #define MCP4728_MAX_VALUE ((1 << 12) - 1)
 
+#define MCP4728_CMD_FAST_WRITE (0x00)            // Fast write for DAC Input Registers of every channel (A to D)
 #define MCP4728_CMD_WRITE_MULTI_IR (0x40)        // Sequential multi-write for DAC Input Registers
 #define MCP4728_CMD_WRITE_MULTI_IR_EEPROM (0x50) // Sequential write for DAC Input Registers and EEPROM
 
@@ -83,6 +84,29 @@ static inline size_t mcp4728_build_write_cmd(uint8_t* buffer, size_t len, mcp472
    return BUF_SIZE;
 }
 
+// Fast write of every channel in a single transaction. VREF and gain are left unchanged, so set them first with mcp4728_build_write_cmd().
+// Outputs update while the LDAC pin is low, so holding LDAC high during the write and then pulsing it low updates every channel at once.
+static inline size_t mcp4728_build_fast_write_cmd(uint8_t* buffer, size_t len, const uint16_t values[MCP4728_MAX_CHANNELS], mcp4728_pd_mode_t mode) {
+   static const size_t BUF_SIZE = MCP4728_MAX_CHANNELS * 2;
+
+   if (len < BUF_SIZE)
+      return 0;
+
+   // ---------------------------------------------------------------------------------
+   // |               0                   |               1                 | ... B, C, D
+   // ---------------------------------------------------------------------------------
+   // C2 C1 PD1 PD0 D11 D10 D9 D8 [A] D7 D6 D5 D4 D3 D2 D1 D0 [A]     (channel A)
+
+   for (size_t i = 0; i < MCP4728_MAX_CHANNELS; i++) {
+      const uint16_t value = (values[i] & MCP4728_MAX_VALUE) | (mode << 12);
+
+      buffer[i * 2] = MCP4728_CMD_FAST_WRITE | ((value >> 8) & 0x3F);
+      buffer[i * 2 + 1] = value & 0xFF;
+   }
+
+   return BUF_SIZE;
+}
+
 #ifdef __cplusplus
 }
 #endif
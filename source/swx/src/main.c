@@ -28,6 +28,7 @@
 #include "trigger.h"
 #include "output.h"
 #include "pulse_gen.h"
+#include "vm.h"
 
 #include "protocol.h"
 
@@ -101,6 +102,9 @@ int main() {
    // Initialize input trigger handling
    trigger_init();
 
+   // Initialize bytecode interpreter for on-device routines
+   vm_init();
+
    // Initialize UART and protocol handling
    protocol_init();
 
@@ -109,6 +113,7 @@ int main() {
 
       pulse_gen_process();
       trigger_process();
+      vm_process();
    }
 }
 
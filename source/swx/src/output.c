@@ -21,6 +21,7 @@
 
 #include <pico/util/queue.h>
 #include <hardware/adc.h>
+#include <hardware/sync.h>
 
 #include "error.h"
 #include "util/i2c.h"
@@ -30,56 +31,98 @@
 
 #include "pulse_gen.pio.h"
 #define CHANNEL_PIO_PROGRAM (pio_pulse_gen_program)
-#define CHANNEL_PIO (pio0)
+#define CHANNEL_PIO_COUNT ((CHANNEL_COUNT + NUM_PIO_STATE_MACHINES - 1) / NUM_PIO_STATE_MACHINES) // Number of PIO blocks used by channels
+#define CHANNEL_PIO(ch_index) (pio_get_instance((ch_index) / NUM_PIO_STATE_MACHINES))             // PIO block driving the channel
+#define CHANNEL_SM(ch_index) ((ch_index) % NUM_PIO_STATE_MACHINES)                                 // State machine within the PIO block
 
-#define CH(pinGateA, pinGateB, dacChannel)                                                                                                                               \
+static_assert(CHANNEL_COUNT <= NUM_PIOS * NUM_PIO_STATE_MACHINES); // Each channel needs its own state machine
+
+#define PULSE_EPOCH_HISTORY (8) // Number of invalidation cutoffs kept per channel, pulses older than this many invalidations are dropped
+
+#define CH(pinGateA, pinGateB, dacAddress, dacChannel)                                                                                                                   \
    {                                                                                                                                                                     \
        .pin_gate_a = (pinGateA),                                                                                                                                         \
        .pin_gate_b = (pinGateB),                                                                                                                                         \
+       .dac_address = (dacAddress),                                                                                                                                      \
        .dac_channel = (dacChannel),                                                                                                                                      \
+       .dac_value = DAC_MAX_VALUE,                                                                                                                                       \
        .status = CHANNEL_INVALID,                                                                                                                                        \
-       .max_power = 0.0f,                                                                                                                                                \
+       .max_power = 0,                                                                                                                                                   \
    }
 
 static inline void calibrate();
 static float read_voltage();
-static bool write_dac(const channel_t* ch, uint16_t value);
+static bool write_dac(channel_t* ch, uint16_t value);
+static bool write_dac_fast(uint8_t address);
 static void set_drive_enabled(bool enabled);
 
 typedef struct {
-   uint8_t channel;
-   float power;
-} pwr_cmd_t;
-
-typedef struct {
-   uint32_t abs_time_us;
-   uint16_t pos_us;
-   uint16_t neg_us;
-} pulse_t;
+   bool active;     // True if the burst is still being written into the PIO FIFO.
+   pulse_t pulse;   // The burst being written.
+   uint8_t index;   // Index of the next pulse in the burst.
+   uint32_t pad_us; // Idle time still to be inserted before the next pulse.
+} burst_state_t;
+
+// Channels 5-8 are optional, so check the board defines them before they are used
+#if CHANNEL_COUNT > 4 && !(defined(PIN_CH5_GA) && defined(PIN_CH5_GB) && defined(CH5_DAC_ADDR) && defined(CH5_DAC_CH))
+#error "CHANNEL_COUNT > 4 requires PIN_CH5_GA, PIN_CH5_GB, CH5_DAC_ADDR, and CH5_DAC_CH board defines"
+#endif
+#if CHANNEL_COUNT > 5 && !(defined(PIN_CH6_GA) && defined(PIN_CH6_GB) && defined(CH6_DAC_ADDR) && defined(CH6_DAC_CH))
+#error "CHANNEL_COUNT > 5 requires PIN_CH6_GA, PIN_CH6_GB, CH6_DAC_ADDR, and CH6_DAC_CH board defines"
+#endif
+#if CHANNEL_COUNT > 6 && !(defined(PIN_CH7_GA) && defined(PIN_CH7_GB) && defined(CH7_DAC_ADDR) && defined(CH7_DAC_CH))
+#error "CHANNEL_COUNT > 6 requires PIN_CH7_GA, PIN_CH7_GB, CH7_DAC_ADDR, and CH7_DAC_CH board defines"
+#endif
+#if CHANNEL_COUNT > 7 && !(defined(PIN_CH8_GA) && defined(PIN_CH8_GB) && defined(CH8_DAC_ADDR) && defined(CH8_DAC_CH))
+#error "CHANNEL_COUNT > 7 requires PIN_CH8_GA, PIN_CH8_GB, CH8_DAC_ADDR, and CH8_DAC_CH board defines"
+#endif
 
 channel_t channels[CHANNEL_COUNT] = {
-    CH(PIN_CH1_GA, PIN_CH1_GB, CH1_DAC_CH),
+    CH(PIN_CH1_GA, PIN_CH1_GB, CH1_DAC_ADDR, CH1_DAC_CH),
 #if CHANNEL_COUNT > 1
-    CH(PIN_CH2_GA, PIN_CH2_GB, CH2_DAC_CH),
+    CH(PIN_CH2_GA, PIN_CH2_GB, CH2_DAC_ADDR, CH2_DAC_CH),
+#endif
 #if CHANNEL_COUNT > 2
-    CH(PIN_CH3_GA, PIN_CH3_GB, CH3_DAC_CH),
+    CH(PIN_CH3_GA, PIN_CH3_GB, CH3_DAC_ADDR, CH3_DAC_CH),
+#endif
 #if CHANNEL_COUNT > 3
-    CH(PIN_CH4_GA, PIN_CH4_GB, CH4_DAC_CH),
+    CH(PIN_CH4_GA, PIN_CH4_GB, CH4_DAC_ADDR, CH4_DAC_CH),
+#endif
+#if CHANNEL_COUNT > 4
+    CH(PIN_CH5_GA, PIN_CH5_GB, CH5_DAC_ADDR, CH5_DAC_CH),
+#endif
+#if CHANNEL_COUNT > 5
+    CH(PIN_CH6_GA, PIN_CH6_GB, CH6_DAC_ADDR, CH6_DAC_CH),
 #endif
+#if CHANNEL_COUNT > 6
+    CH(PIN_CH7_GA, PIN_CH7_GB, CH7_DAC_ADDR, CH7_DAC_CH),
 #endif
+#if CHANNEL_COUNT > 7
+    CH(PIN_CH8_GA, PIN_CH8_GB, CH8_DAC_ADDR, CH8_DAC_CH),
 #endif
 };
 
-uint8_t require_zero_mask = 0xff;
+ch_mask_t require_zero_mask = CHANNEL_MASK_ALL;
 
 static bool drv_enabled;
-static uint pio_offset;
+static uint pio_offsets[CHANNEL_PIO_COUNT]; // Pulse gen program offset in each PIO block
 
 static queue_t pulse_queues[CHANNEL_COUNT];
-static queue_t power_queue;
+static burst_state_t bursts[CHANNEL_COUNT];
+static ch_mask_t dac_pending_mask = 0; // Channels with a DAC value waiting to be written
 
 static uint32_t last_pulse_time_us = 0;
 
+// Written by core0 (output_pulse_invalidate), read by core1 (output_process_pulse).
+static volatile uint8_t pulse_epochs[CHANNEL_COUNT];                           // Current epoch, incremented every invalidation
+static volatile uint32_t pulse_cutoffs_us[CHANNEL_COUNT][PULSE_EPOCH_HISTORY]; // Invalidation timestamp that started each epoch
+
+// Written by core0 (output_power), read by core1 (output_process_power). One word per channel, so a single store publishes a value.
+// Upper half is a sequence number incremented every write, lower half is the power. Only the latest value is kept.
+static volatile uint32_t power_mailboxes[CHANNEL_COUNT];
+static uint16_t power_seqs[CHANNEL_COUNT];      // Sequence of the last value written (core0)
+static uint16_t power_seen_seqs[CHANNEL_COUNT]; // Sequence of the last value processed (core1)
+
 void output_init() {
    LOG_DEBUG("Init output...");
 
@@ -95,6 +138,11 @@ void output_init() {
    gpio_disable_pulls(PIN_I2C_SDA_DAC); // using hardware pullups
    gpio_disable_pulls(PIN_I2C_SCL_DAC);
 
+#ifdef PIN_DAC_LDAC
+   // Hold DAC outputs until latched, so a batch of fast writes updates every channel at once
+   init_gpio(PIN_DAC_LDAC, GPIO_OUT, 1);
+#endif
+
    // Init ADC
    adc_gpio_init(PIN_ADC_SENSE);
    adc_init();
@@ -110,26 +158,36 @@ void output_init() {
       init_gpio(ch->pin_gate_b, GPIO_OUT, 0);
 
       // Claim PIO state machine
-      pio_sm_claim(CHANNEL_PIO, ch_index);
+      pio_sm_claim(CHANNEL_PIO(ch_index), CHANNEL_SM(ch_index));
    }
 
    for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++)
       queue_init(&pulse_queues[ch_index], sizeof(pulse_t), 64);
 
-   queue_init(&power_queue, sizeof(pwr_cmd_t), 16);
+   for (size_t pio_index = 0; pio_index < CHANNEL_PIO_COUNT; pio_index++) {
+      LOG_DEBUG("Load PIO pulse gen program: pio=%u", pio_index);
 
-   LOG_DEBUG("Load PIO pulse gen program");
-   if (pio_can_add_program(CHANNEL_PIO, &CHANNEL_PIO_PROGRAM)) {
-      pio_offset = pio_add_program(CHANNEL_PIO, &CHANNEL_PIO_PROGRAM);
-   } else {
-      // Panic if program cant be added. This should not normally occur.
-      LOG_FATAL("PIO program cant be added! No program space!");
+      const PIO pio = pio_get_instance(pio_index);
+      if (pio_can_add_program(pio, &CHANNEL_PIO_PROGRAM)) {
+         pio_offsets[pio_index] = pio_add_program(pio, &CHANNEL_PIO_PROGRAM);
+      } else {
+         // Panic if program cant be added. This should not normally occur.
+         LOG_FATAL("PIO program cant be added! No program space!");
+      }
    }
 
-   // Ensure DAC is reachable at address.
-   if (!i2c_check(I2C_PORT_DAC, I2C_ADDRESS_DAC)) {
-      swx_err |= SWX_ERR_HW_DAC;
-      LOG_ERROR("No response from DAC @ address 0x%02x", I2C_ADDRESS_DAC);
+   // Ensure each DAC is reachable at its address. Channels sharing a DAC are only checked once.
+   for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+      const uint8_t address = channels[ch_index].dac_address;
+
+      bool checked = false;
+      for (size_t i = 0; i < ch_index; i++)
+         checked |= channels[i].dac_address == address;
+
+      if (!checked && !i2c_check(I2C_PORT_DAC, address)) {
+         swx_err |= SWX_ERR_HW_DAC;
+         LOG_ERROR("No response from DAC @ address 0x%02x", address);
+      }
    }
 
    // Ensure output board is installed.
@@ -145,8 +203,9 @@ void output_scram() {
 
    for (size_t i = 0; i < CHANNEL_COUNT; i++) {
       channels[i].status = CHANNEL_FAULT;
+      bursts[i].active = false;
 
-      pio_sm_set_enabled(CHANNEL_PIO, i, false);
+      pio_sm_set_enabled(CHANNEL_PIO(i), CHANNEL_SM(i), false);
 
       // since pins are used by PIO, mux them back to SIO
       init_gpio(channels[i].pin_gate_a, GPIO_OUT, 0);
@@ -172,6 +231,8 @@ static inline void calibrate() {
    // Switch on power
    set_drive_enabled(true);
 
+   uint32_t sm_masks[CHANNEL_PIO_COUNT] = {0}; // State machines in each PIO block to start once calibration is done
+
    for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
       channel_t* ch = &channels[ch_index];
 
@@ -224,8 +285,8 @@ static inline void calibrate() {
       if (ch->status == CHANNEL_READY) {
          // Init PIO state machine with pulse gen program.
          // Must be done after test, since PIO uses different GPIO muxing compared to regular GPIO.
-         pulse_gen_program_init(CHANNEL_PIO, ch_index, pio_offset, ch->pin_gate_a, ch->pin_gate_b);
-         pio_sm_set_enabled(CHANNEL_PIO, ch_index, true); // Start state machine
+         pulse_gen_program_init(CHANNEL_PIO(ch_index), CHANNEL_SM(ch_index), pio_offsets[ch_index / NUM_PIO_STATE_MACHINES], ch->pin_gate_a, ch->pin_gate_b);
+         sm_masks[ch_index / NUM_PIO_STATE_MACHINES] |= (1u << CHANNEL_SM(ch_index));
       } else {
          swx_err |= SWX_ERR_CAL;
          ch->status = CHANNEL_FAULT;
@@ -234,6 +295,11 @@ static inline void calibrate() {
       }
    }
 
+   // Start state machines together, so their clock dividers are in phase and channel pulse timing is aligned.
+   // Each PIO block is started separately, so blocks are offset by the few cycles between the writes.
+   for (size_t pio_index = 0; pio_index < CHANNEL_PIO_COUNT; pio_index++)
+      pio_enable_sm_mask_in_sync(pio_get_instance(pio_index), sm_masks[pio_index]);
+
    // Disable PSU since we are done with calibration
    set_drive_enabled(false);
 
@@ -271,97 +337,254 @@ static float read_voltage() {
    return conv_factor * counts;
 }
 
-static bool write_dac(const channel_t* ch, uint16_t value) {
+static bool write_dac(channel_t* ch, uint16_t value) {
    if (swx_err & SWX_ERR_HW_DAC)
       return false;
 
+   ch->dac_value = value;
+
    uint8_t buffer[3];
 
    const size_t len = mcp4728_build_write_cmd(buffer, sizeof(buffer), ch->dac_channel, value, MCP4728_VREF_VDD, MCP4728_GAIN_ONE, MCP4728_PD_NORMAL, MCP4728_UDAC_FALSE);
    if (len == 0)
       LOG_FATAL("MCP4728 build cmd failed!"); // should not happen
 
-   const int ret = i2c_write(I2C_PORT_DAC, I2C_ADDRESS_DAC, buffer, len, false, I2C_DEVICE_TIMEOUT);
+   const int ret = i2c_write(I2C_PORT_DAC, ch->dac_address, buffer, len, false, I2C_DEVICE_TIMEOUT);
    if (ret <= 0) {
-      LOG_ERROR("DAC write failed! ch=%u ret=%d", ch->dac_channel, ret);
+      LOG_ERROR("DAC write failed! addr=0x%02x ch=%u ret=%d", ch->dac_address, ch->dac_channel, ret);
       return false;
    }
    return true;
 }
 
-void output_process_pulse() {
+// Write the value of every channel on the DAC in one fast write. Channels that aren't ready, and DAC channels without an output channel, are held off.
+static bool write_dac_fast(uint8_t address) {
+   if (swx_err & SWX_ERR_HW_DAC)
+      return false;
+
+   uint16_t values[MCP4728_MAX_CHANNELS];
+   for (size_t i = 0; i < MCP4728_MAX_CHANNELS; i++)
+      values[i] = DAC_MAX_VALUE;
+
+   for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+      const channel_t* const ch = &channels[ch_index];
+      if (ch->dac_address == address)
+         values[ch->dac_channel % MCP4728_MAX_CHANNELS] = ch->status == CHANNEL_READY ? ch->dac_value : DAC_MAX_VALUE;
+   }
+
+   uint8_t buffer[MCP4728_MAX_CHANNELS * 2];
+
+   const size_t len = mcp4728_build_fast_write_cmd(buffer, sizeof(buffer), values, MCP4728_PD_NORMAL);
+   if (len == 0)
+      LOG_FATAL("MCP4728 build cmd failed!"); // should not happen
+
+   const int ret = i2c_write(I2C_PORT_DAC, address, buffer, len, false, I2C_DEVICE_TIMEOUT);
+   if (ret <= 0) {
+      LOG_ERROR("DAC fast write failed! addr=0x%02x ret=%d", address, ret);
+      return false;
+   }
+   return true;
+}
+
+// Fetch the next PIO word for the burst. Returns false once all pulses in the burst have been written.
+static bool burst_next_word(burst_state_t* burst, uint32_t* word) {
    static const uint16_t PW_MAX = (1 << PULSE_GEN_BITS) - 1;
+   static const uint8_t GAP_MAX = (1 << PULSE_GEN_GAP_BITS) - 1;
+   static const uint8_t IDLE_MAX = (1 << PULSE_GEN_IDLE_BITS) - 1;
+
+   const pulse_t* const pulse = &burst->pulse;
+
+   // Pad idle time that didn't fit in the previous pulse word
+   if (burst->pad_us >= PULSE_GEN_IDLE_UNIT_US + PULSE_GEN_OVERHEAD_US) {
+      const uint8_t idle = MIN((burst->pad_us - PULSE_GEN_OVERHEAD_US) / PULSE_GEN_IDLE_UNIT_US, IDLE_MAX);
+      burst->pad_us -= (idle * PULSE_GEN_IDLE_UNIT_US) + PULSE_GEN_OVERHEAD_US;
+
+      *word = pulse_gen_build_word(0, 0, 0, idle);
+      return true;
+   }
+
+   const uint8_t count = MAX(pulse->count, 1);
+   if (burst->index >= count)
+      return false;
+
+   uint16_t pos_us = MIN(pulse->pos_us, PW_MAX);
+   uint16_t neg_us = MIN(pulse->neg_us, PW_MAX);
+   const uint8_t gap_us = neg_us ? MIN(pulse->gap_us, GAP_MAX) : 0;
+
+   // Swap phases for negative pulses, alternating polarity every pulse if required
+   const bool negative = !!(pulse->flags & PULSE_FLAG_NEGATIVE) ^ ((pulse->flags & PULSE_FLAG_ALTERNATE) && (burst->index & 1));
+   if (negative) {
+      const uint16_t tmp = pos_us;
+      pos_us = neg_us;
+      neg_us = tmp;
+   }
+
+   uint8_t idle = 0;
+   if (++burst->index < count) { // Space pulses within the burst by the burst period, carrying any remainder to the next pulse
+      const uint32_t width_us = pos_us + gap_us + neg_us + PULSE_GEN_OVERHEAD_US;
+      if (pulse->period_us > width_us)
+         burst->pad_us += pulse->period_us - width_us;
+
+      idle = MIN(burst->pad_us / PULSE_GEN_IDLE_UNIT_US, IDLE_MAX);
+      burst->pad_us -= idle * PULSE_GEN_IDLE_UNIT_US;
+   }
+
+   *word = pulse_gen_build_word(pos_us, gap_us, neg_us, idle);
+   return true;
+}
+
+// Returns true if the pulse was invalidated, i.e. queued before an invalidation and starting at or after its cutoff.
+// Pulses are queued in epoch order, so a pulse is only invalidated by the invalidation that followed the epoch it was queued in.
+static inline bool pulse_invalidated(uint8_t ch_index, const pulse_t* pulse) {
+   const uint8_t age = pulse_epochs[ch_index] - pulse->epoch;
+   if (age == 0)
+      return false;
+   if (age >= PULSE_EPOCH_HISTORY) // Cutoff was overwritten, pulse is long overdue anyway
+      return true;
+
+   const uint32_t cutoff_us = pulse_cutoffs_us[ch_index][(uint8_t)(pulse->epoch + 1) % PULSE_EPOCH_HISTORY];
+   return (int32_t)(pulse->abs_time_us - cutoff_us) >= 0;
+}
 
+void output_process_pulse() {
    pulse_t pulse;
    for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+      burst_state_t* const burst = &bursts[ch_index];
 
-      if (!queue_try_peek(&pulse_queues[ch_index], &pulse)) {
-         // Disable drive power if queue is empty, and more than 30 seconds since last output pulse.
-         if (drv_enabled && (time_us_32() - last_pulse_time_us) > 30000000u)
-            set_drive_enabled(false);
+      const PIO pio = CHANNEL_PIO(ch_index);
+      const uint sm = CHANNEL_SM(ch_index);
 
-         continue;
-      }
+      if (!burst->active) {
+         if (!queue_try_peek(&pulse_queues[ch_index], &pulse)) {
+            // Disable drive power if queue is empty, and more than 30 seconds since last output pulse.
+            if (drv_enabled && (time_us_32() - last_pulse_time_us) > 30000000u)
+               set_drive_enabled(false);
+
+            continue;
+         }
+
+         if (pulse_invalidated(ch_index, &pulse)) { // Drop without waiting, so replanned pulses behind it aren't delayed
+            queue_try_remove(&pulse_queues[ch_index], &pulse);
+            continue;
+         }
+
+         if (time_us_32() < pulse.abs_time_us)
+            continue;
 
-      if (time_us_32() >= pulse.abs_time_us) {
          queue_try_remove(&pulse_queues[ch_index], &pulse); // Always drain pulse queue, even if errors or channel is not ready to output pulses.
 
          // Ignore pulses if requires zeroing, wait time above 1 second, or not ready.
-         if ((require_zero_mask & (1 << ch_index)) || pulse.abs_time_us > time_us_32() + 1000000u || channels[ch_index].status != CHANNEL_READY)
+         if ((require_zero_mask & (1u << ch_index)) || pulse.abs_time_us > time_us_32() + 1000000u || channels[ch_index].status != CHANNEL_READY)
             continue;
 
-         if (pio_sm_is_tx_fifo_full(CHANNEL_PIO, ch_index)) {
+         if (pio_sm_is_tx_fifo_full(pio, sm)) {
             LOG_WARN("Pulse queue full! ch=%u", ch_index);
             continue;
          }
 
-         if (pulse.pos_us > PW_MAX)
-            pulse.pos_us = PW_MAX;
-         if (pulse.neg_us > PW_MAX)
-            pulse.neg_us = PW_MAX;
-
-         static_assert(PULSE_GEN_BITS <= 16); // Ensure we can fit the bits.
-         uint32_t val = (pulse.pos_us << PULSE_GEN_BITS) | (pulse.neg_us);
-         pio_sm_put(CHANNEL_PIO, ch_index, val);
+         burst->pulse = pulse;
+         burst->index = 0;
+         burst->pad_us = 0;
+         burst->active = true;
 
          last_pulse_time_us = time_us_32();
 
          if (!drv_enabled)
             set_drive_enabled(true);
+
+      } else if ((require_zero_mask & (1u << ch_index)) || channels[ch_index].status != CHANNEL_READY) {
+         burst->active = false; // Abort remainder of burst
+         continue;
+      }
+
+      // Write as much of the burst as fits into the PIO FIFO, the remainder is written on later calls
+      uint32_t word;
+      while (!pio_sm_is_tx_fifo_full(pio, sm)) {
+         if (!burst_next_word(burst, &word)) {
+            burst->active = false;
+            break;
+         }
+
+         static_assert(PULSE_GEN_BITS * 2 + PULSE_GEN_GAP_BITS + PULSE_GEN_IDLE_BITS <= 32); // Ensure we can fit the bits.
+         pio_sm_put(pio, sm, word);
       }
    }
 }
 
 void output_process_power() {
-   if (i2c_get_write_available(I2C_PORT_DAC) < 5) // break, if I2C is going to have blocking writes
-      return;
+   // Collect the latest power of each channel that has been written since the last call
+   for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+      const uint32_t mailbox = power_mailboxes[ch_index]; // Local copy, since volatile
 
-   pwr_cmd_t cmd;
-   if (queue_try_remove(&power_queue, &cmd)) {
-      channel_t* const ch = &channels[cmd.channel];
+      const uint16_t seq = mailbox >> 16;
+      if (seq == power_seen_seqs[ch_index])
+         continue;
+      power_seen_seqs[ch_index] = seq;
+
+      channel_t* const ch = &channels[ch_index];
 
       if (ch->status != CHANNEL_READY)
-         return;
+         continue;
 
-      float pwr = fclamp(cmd.power, 0.0f, 1.0f) * fclamp(ch->max_power, 0.0f, 1.0f);
+      uint16_t pwr = q16_mul(mailbox & UINT16_MAX, ch->max_power);
 
-      if (require_zero_mask & (1 << cmd.channel)) {
-         if (ch->max_power <= 0.01f) {
-            require_zero_mask &= ~(1 << cmd.channel);
+      if (require_zero_mask & (1u << ch_index)) {
+         if (ch->max_power <= UINT16_MAX / 100) {
+            require_zero_mask &= ~(1u << ch_index);
          } else {
-            pwr = 0.0f;
+            pwr = 0;
          }
       }
 
-      int16_t dacValue = (ch->cal_value + CH_CAL_OFFSET) - (2000 * pwr);
+      int16_t dacValue = (ch->cal_value + CH_CAL_OFFSET) - ((2000u * pwr) / UINT16_MAX);
 
       if (dacValue < 0 || dacValue > DAC_MAX_VALUE) {
-         LOG_WARN("Invalid power calculated! ch=%u pwr=%f dac=%d", cmd.channel, pwr, dacValue);
-         return;
+         LOG_WARN("Invalid power calculated! ch=%u pwr=%u dac=%d", ch_index, pwr, dacValue);
+         continue;
       }
 
-      write_dac(ch, (uint16_t)dacValue);
+      ch->dac_value = dacValue;
+      dac_pending_mask |= (1u << ch_index);
+   }
+
+   if (!dac_pending_mask)
+      return;
+
+   // One transaction per DAC with a pending channel, channels sharing a DAC are written together
+   ch_mask_t unwritten_mask = dac_pending_mask;
+   bool written = false;
+
+   for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+      if (~unwritten_mask & (1u << ch_index))
+         continue;
+
+      // break, if I2C is going to have blocking writes. Remaining DACs are written (and latched) on a later call.
+      if (i2c_get_write_available(I2C_PORT_DAC) < MCP4728_MAX_CHANNELS * 2)
+         return;
+
+      const uint8_t address = channels[ch_index].dac_address;
+      const bool ok = write_dac_fast(address);
+
+      for (size_t i = ch_index; i < CHANNEL_COUNT; i++) {
+         if (channels[i].dac_address != address)
+            continue;
+
+         unwritten_mask &= ~(1u << i);
+         if (ok) // Failed writes stay pending, so they are retried on a later call
+            dac_pending_mask &= ~(1u << i);
+      }
+      written |= ok;
    }
+
+   if (!written)
+      return;
+
+#ifdef PIN_DAC_LDAC
+   // Latch the written DACs at once, so channels update without skew
+   gpio_put(PIN_DAC_LDAC, 0);
+   busy_wait_us_32(1);
+   gpio_put(PIN_DAC_LDAC, 1);
+#endif
 }
 
 bool output_pulse(uint8_t ch_index, uint16_t pos_us, uint16_t neg_us, uint32_t abs_time_us) {
@@ -372,17 +595,40 @@ bool output_pulse(uint8_t ch_index, uint16_t pos_us, uint16_t neg_us, uint32_t a
        .pos_us = pos_us,
        .neg_us = neg_us,
        .abs_time_us = abs_time_us,
+       .epoch = pulse_epochs[ch_index],
    };
 
    return queue_try_add(&pulse_queues[ch_index], &pulse);
 }
 
-bool output_power(uint8_t ch_index, float power) {
+bool output_pulse_burst(uint8_t ch_index, const pulse_t* pulse) {
    if (ch_index >= CHANNEL_COUNT)
       return false;
 
-   pwr_cmd_t cmd = {.channel = ch_index, .power = power};
-   return queue_try_add(&power_queue, &cmd);
+   pulse_t queued = *pulse;
+   queued.epoch = pulse_epochs[ch_index];
+
+   return queue_try_add(&pulse_queues[ch_index], &queued);
+}
+
+void output_pulse_invalidate(uint8_t ch_index, uint32_t from_us) {
+   if (ch_index >= CHANNEL_COUNT)
+      return;
+
+   const uint8_t epoch = pulse_epochs[ch_index] + 1;
+   pulse_cutoffs_us[ch_index][epoch % PULSE_EPOCH_HISTORY] = from_us;
+
+   __dmb(); // Publish the cutoff before the epoch, since core1 reads them in the opposite order
+   pulse_epochs[ch_index] = epoch;
+}
+
+bool output_power(uint8_t ch_index, uint16_t power) {
+   if (ch_index >= CHANNEL_COUNT)
+      return false;
+
+   const uint16_t seq = ++power_seqs[ch_index];
+   power_mailboxes[ch_index] = ((uint32_t)seq << 16) | power; // Overwrites any value core1 hasn't processed yet
+   return true;
 }
 
 bool output_check_installed() {
@@ -29,20 +29,40 @@ typedef struct {
    const uint8_t pin_gate_a; // GPIO pin for NFET gate A
    const uint8_t pin_gate_b; // GPIO pin for NFET gate B
 
+   const uint8_t dac_address; // I2C address of the MCP4728 driving this channel
    const uint8_t dac_channel;
+   uint16_t dac_value; // The value the DAC channel is set to, written with the other channels of the DAC by each fast write
 
    uint16_t cal_value;
 
    channel_status_t status;
 
-   float max_power; // Maximum power level (e.g. front panel knobs), range [0.0, 1.0]
+   uint16_t max_power; // Maximum power level (e.g. front panel knobs), as a fraction of UINT16_MAX
 } channel_t;
 
+#define PULSE_FLAG_NEGATIVE (1 << 0)  // First pulse starts with the negative phase (gate B), swapping pos_us and neg_us.
+#define PULSE_FLAG_ALTERNATE (1 << 1) // Polarity of each pulse in the burst alternates.
+
+typedef struct {
+   uint32_t abs_time_us; // The absolute timestamp to start the pulse (or first pulse of the burst).
+
+   uint16_t pos_us; // Positive phase width (gate A).
+   uint16_t neg_us; // Negative phase width (gate B). Zero for monophasic pulses.
+   uint8_t gap_us;  // Gap between the positive and negative phases.
+
+   uint8_t count;      // Number of pulses in the burst. Zero or one for a single pulse.
+   uint16_t period_us; // Period between the start of each pulse in the burst.
+
+   uint8_t flags; // See PULSE_FLAG*
+
+   uint8_t epoch; // Stamped by output_pulse_burst(), used to drop pulses queued before output_pulse_invalidate().
+} pulse_t;
+
 extern channel_t channels[CHANNEL_COUNT];
 
 // Bitmask indicating if a channel needs max_power to be less than 1% to enable output.
 // Once channel condition is met, associated bit will be zeroed.
-extern uint8_t require_zero_mask;
+extern ch_mask_t require_zero_mask;
 
 void output_init();
 void output_scram();
@@ -51,7 +71,14 @@ void output_process_power();
 void output_process_pulse();
 
 bool output_pulse(uint8_t ch_index, uint16_t pos_us, uint16_t neg_us, uint32_t abs_time_us);
-bool output_power(uint8_t ch_index, float power);
+bool output_pulse_burst(uint8_t ch_index, const pulse_t* pulse);
+
+// Drop queued pulses for the channel that start at or after the given timestamp. Pulses queued afterwards are kept.
+// Pulses sooner than the timestamp might already be output, so are kept too. The timestamp must not be before the previous one.
+void output_pulse_invalidate(uint8_t ch_index, uint32_t from_us);
+
+// Set the channel power (fraction of UINT16_MAX). Replaces any value not yet written to the DAC, so never blocks or drops the latest value.
+bool output_power(uint8_t ch_index, uint16_t power);
 
 bool output_check_installed();
 
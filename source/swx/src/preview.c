@@ -0,0 +1,131 @@
+/*
+ * swx
+ * Copyright (C) 2024 saawsm
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "preview.h"
+
+#include "util/pulse_math.h"
+
+static inline bool emit(preview_event_t* events, size_t* count, size_t max_events, uint32_t time_us, preview_event_type_t type, uint16_t value) {
+   if (*count >= max_events)
+      return false;
+
+   events[(*count)++] = (preview_event_t){.time_us = time_us, .type = type, .value = value};
+   return true;
+}
+
+size_t preview_run(const preview_channel_t* ch, uint32_t window_us, preview_event_t* events, size_t max_events, uint32_t* covered_us) {
+   size_t count = 0;
+   *covered_us = window_us;
+
+   if (!ch->enabled)
+      return 0;
+
+   // Ramp phase increment per microsecond, same as the generator
+   uint32_t ramp_phase_inc[2] = {0};
+   for (size_t off_ramp = 0; off_ramp < 2; off_ramp++) {
+      const uint32_t ramp_time_us = ch->state_time_us[off_ramp ? PREVIEW_STATE_OFF_RAMP : PREVIEW_STATE_ON_RAMP];
+      if (ramp_time_us)
+         ramp_phase_inc[off_ramp] = phase_inc_us(ramp_time_us);
+   }
+
+   // Pulse period = 1e7 / dHz microseconds, continuing the generator pulse timebase
+   const uint64_t period_q32 = ch->freq_q8 ? (10000000ull << 40) / ch->freq_q8 : 0;
+   nco_t pulse_nco = {
+       .next_time_us = ch->next_pulse_us,
+       .period_us = period_q32 >> 32,
+       .period_frac = (uint32_t)period_q32,
+       .period_acc = ch->pulse_acc,
+   };
+
+   bool holding = true; // If every state has zero duration, the current state is held
+   for (size_t i = 0; i < TOTAL_PREVIEW_STATES; i++)
+      holding &= ch->state_time_us[i] == 0;
+
+   const bool pulses = period_q32 && ch->power && ch->pulse_width;
+
+   uint8_t state = ch->state_index < TOTAL_PREVIEW_STATES ? ch->state_index : 0;
+   uint32_t state_start_us = 0u - ch->state_elapsed_us;
+   uint32_t now_us = 0;
+   int32_t last_power = -1;
+
+   emit(events, &count, max_events, 0, PREVIEW_EVENT_STATE, state);
+
+   for (uint32_t steps = 0; steps < PREVIEW_MAX_STEPS; steps++) {
+      const uint32_t state_end_us = state_start_us + ch->state_time_us[state];
+
+      if (pulses && state != PREVIEW_STATE_OFF)
+         nco_due(&pulse_nco, now_us); // Pulses were skipped (e.g. off state), restart from now if more than a period behind
+
+      // The next pulse, if this state generates them and it comes before the state ends
+      const uint32_t pulse_time_us = deadline_reached(pulse_nco.next_time_us, now_us) ? now_us : pulse_nco.next_time_us;
+      if (pulses && state != PREVIEW_STATE_OFF && (holding || !deadline_reached(state_end_us, pulse_time_us))) {
+         if (pulse_time_us >= window_us)
+            return count;
+
+         uint16_t power = ch->power;
+
+         // Scale power by the ramp envelope, elapsed time is measured from when the state ideally started
+         if ((state == PREVIEW_STATE_ON_RAMP || state == PREVIEW_STATE_OFF_RAMP) && ch->state_time_us[state]) {
+            const bool off_ramp = state == PREVIEW_STATE_OFF_RAMP;
+
+            power = q16_mul(power, ramp_envelope(ch->ramp_table, ramp_phase_inc[off_ramp], off_ramp, pulse_time_us - state_start_us));
+         }
+
+         uint16_t pulse_width = ch->pulse_width;
+         if (ch->power_mode == POWER_MODE_WIDTH) {
+            pulse_width = width_power_scale(ch->power_lut, pulse_width, power, ch->power_max);
+            power = ch->power_max;
+         }
+
+         if (power != last_power) {
+            if (!emit(events, &count, max_events, pulse_time_us, PREVIEW_EVENT_POWER, power)) {
+               *covered_us = pulse_time_us;
+               return count;
+            }
+            last_power = power;
+         }
+
+         if (pulse_width && !emit(events, &count, max_events, pulse_time_us, PREVIEW_EVENT_PULSE, pulse_width)) {
+            *covered_us = pulse_time_us;
+            return count;
+         }
+
+         now_us = pulse_time_us;
+         nco_advance(&pulse_nco);
+         continue;
+      }
+
+      if (holding)
+         return count; // Nothing changes for the rest of the window
+
+      // Next state starts when this one ideally ended, same as the generator
+      const uint32_t time_us = deadline_reached(state_end_us, now_us) ? now_us : state_end_us;
+      if (time_us >= window_us)
+         return count;
+
+      state_advance(ch->state_time_us, &state, &state_start_us, time_us);
+
+      if (!emit(events, &count, max_events, time_us, PREVIEW_EVENT_STATE, state)) {
+         *covered_us = time_us;
+         return count;
+      }
+      now_us = time_us;
+   }
+
+   *covered_us = now_us; // Out of steps
+   return count;
+}
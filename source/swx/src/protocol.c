@@ -28,6 +28,7 @@
 #include "output.h"
 #include "trigger.h"
 #include "analog_capture.h"
+#include "vm.h"
 
 static const char* const cobs_encode_status_text[] = {
     [COBS_ENCODE_OK] = "ok",
@@ -68,30 +69,36 @@ static inline size_t command_min_arg_length(uint8_t cmd) {
    switch (cmd) {
       case MSG_ID_REQUEST_VERSION:
          return 0;
+      case MSG_ID_CONFIG_BEGIN:
+         return 0;
+      case MSG_ID_CONFIG_COMMIT:
+         return 0;
+      case MSG_ID_CONFIG_ABORT:
+         return 0;
       case MSG_ID_UPDATE_MAX_POWER:
-         return 3;
+         return 4;
       case MSG_ID_REQUEST_MAX_POWER:
-         return 1;
+         return 2;
       case MSG_ID_UPDATE_REQUIRE_ZERO:
-         return 1;
+         return 2;
       case MSG_ID_REQUEST_REQUIRE_ZERO:
          return 0;
       case MSG_ID_UPDATE_CH_AUDIO:
-         return 2;
+         return 3;
       case MSG_ID_REQUEST_CH_AUDIO:
-         return 1;
+         return 2;
       case MSG_ID_UPDATE_CH_EN_MASK:
-         return 1;
+         return 2;
       case MSG_ID_REQUEST_CH_EN_MASK:
          return 0;
       case MSG_ID_UPDATE_CH_PARAM:
-         return 4;
+         return 5;
       case MSG_ID_REQUEST_CH_PARAM:
-         return 2;
+         return 3;
       case MSG_ID_CH_PARAM_UPDATE:
-         return 2;
+         return 3;
       case MSG_ID_REQUEST_CH_STATUS:
-         return 1;
+         return 2;
       case MSG_ID_UPDATE_SEQ:
          return 2;
       case MSG_ID_REQUEST_SEQ:
@@ -107,17 +114,87 @@ static inline size_t command_min_arg_length(uint8_t cmd) {
       case MSG_ID_REQUEST_SEQ_PERIOD:
          return 0;
       case MSG_ID_UPDATE_ACTION:
-         return 8;
+         return 9;
       case MSG_ID_REQUEST_ACTION:
          return 1;
       case MSG_ID_RUN_ACTION_LIST:
          return 2;
+      case MSG_ID_UPDATE_CH_RAMP_CURVE:
+         return 3;
+      case MSG_ID_REQUEST_CH_RAMP_CURVE:
+         return 2;
+      case MSG_ID_UPDATE_CH_WAVEFORM:
+         return 9;
+      case MSG_ID_REQUEST_CH_WAVEFORM:
+         return 2;
       case MSG_ID_UPDATE_TRIGGER:
          return 10;
       case MSG_ID_REQUEST_TRIGGER:
          return 1;
       case MSG_ID_REQUEST_TRIGGER_STATE:
          return 0;
+      case MSG_ID_REQUEST_TIMER_STATS:
+         return 1;
+      case MSG_ID_UPDATE_LOOKAHEAD:
+         return 2;
+      case MSG_ID_REQUEST_LOOKAHEAD:
+         return 0;
+      case MSG_ID_UPDATE_CH_GROUP:
+         return 5;
+      case MSG_ID_REQUEST_CH_GROUP:
+         return 2;
+      case MSG_ID_UPDATE_CH_FREQ_FRAC:
+         return 3;
+      case MSG_ID_REQUEST_CH_FREQ_FRAC:
+         return 2;
+      case MSG_ID_REQUEST_CH_RATE:
+         return 2;
+      case MSG_ID_UPDATE_VM_PROGRAM:
+         return 2;
+      case MSG_ID_VM_START:
+         return 3;
+      case MSG_ID_VM_STOP:
+         return 1;
+      case MSG_ID_REQUEST_VM_STATE:
+         return 1;
+      case MSG_ID_UPDATE_MOD_ROUTE:
+         return 12;
+      case MSG_ID_REQUEST_MOD_ROUTE:
+         return 1;
+      case MSG_ID_UPDATE_CH_POWER_MODE:
+         return 3;
+      case MSG_ID_REQUEST_CH_POWER_MODE:
+         return 2;
+      case MSG_ID_UPDATE_CH_POWER_LUT:
+         return 2 + ((POWER_LUT_SIZE + 1) * 2);
+      case MSG_ID_REQUEST_CH_POWER_LUT:
+         return 2;
+      case MSG_ID_UPDATE_TIMELINE_STEP:
+         return 9;
+      case MSG_ID_REQUEST_TIMELINE_STEP:
+         return 1;
+      case MSG_ID_UPDATE_SCENE_ENTRY:
+         return 7;
+      case MSG_ID_REQUEST_SCENE_ENTRY:
+         return 1;
+      case MSG_ID_UPDATE_TIMELINE_COUNT:
+         return 1;
+      case MSG_ID_REQUEST_TIMELINE_COUNT:
+         return 0;
+      case MSG_ID_CH_PARAM_RAMP:
+         return 7;
+      case MSG_ID_REQUEST_CH_PREVIEW:
+         return 4;
+      case MSG_ID_REQUEST_MORPH_BANK:
+         return 4;
+      case MSG_ID_UPDATE_MORPH_BANK:
+         return 6;
+      case MSG_ID_MORPH_CAPTURE:
+         return 1;
+      case MSG_ID_REQUEST_MORPH:
+         return 0;
+      case MSG_ID_UPDATE_MORPH:
+         return 3;
       case MSG_ID_SHUTDOWN:
          return 0;
       case MSG_ID_RESET_TO_USB_BOOT:
@@ -131,6 +208,49 @@ static inline size_t command_min_arg_length(uint8_t cmd) {
    }
 }
 
+// Returns false if the message only reads state, so the generator doesn't need re-evaluating after it.
+static inline bool command_writes(uint8_t cmd) {
+   switch (cmd) {
+      case MSG_ID_REQUEST_VERSION:
+      case MSG_ID_REQUEST_MAX_POWER:
+      case MSG_ID_REQUEST_REQUIRE_ZERO:
+      case MSG_ID_REQUEST_CH_AUDIO:
+      case MSG_ID_REQUEST_CH_EN_MASK:
+      case MSG_ID_REQUEST_CH_PARAM:
+      case MSG_ID_REQUEST_CH_STATUS:
+      case MSG_ID_REQUEST_SEQ:
+      case MSG_ID_REQUEST_SEQ_COUNT:
+      case MSG_ID_REQUEST_SEQ_PERIOD:
+      case MSG_ID_REQUEST_ACTION:
+      case MSG_ID_REQUEST_CH_RAMP_CURVE:
+      case MSG_ID_REQUEST_CH_WAVEFORM:
+      case MSG_ID_REQUEST_TRIGGER:
+      case MSG_ID_REQUEST_TRIGGER_STATE:
+      case MSG_ID_REQUEST_TIMER_STATS:
+      case MSG_ID_REQUEST_LOOKAHEAD:
+      case MSG_ID_REQUEST_CH_GROUP:
+      case MSG_ID_REQUEST_CH_FREQ_FRAC:
+      case MSG_ID_REQUEST_CH_RATE:
+      case MSG_ID_REQUEST_VM_STATE:
+      case MSG_ID_REQUEST_MOD_ROUTE:
+      case MSG_ID_REQUEST_CH_POWER_MODE:
+      case MSG_ID_REQUEST_CH_POWER_LUT:
+      case MSG_ID_REQUEST_TIMELINE_STEP:
+      case MSG_ID_REQUEST_SCENE_ENTRY:
+      case MSG_ID_REQUEST_TIMELINE_COUNT:
+      case MSG_ID_REQUEST_CH_PREVIEW:
+      case MSG_ID_REQUEST_MORPH_BANK:
+      case MSG_ID_REQUEST_MORPH:
+      case MSG_ID_REQUEST_MIC_PIP_EN:
+      case MSG_ID_REQUEST_ERR:
+      case MSG_ID_REQUEST_MIC_GAIN:
+      case MSG_ID_REQUEST_GAIN:
+         return false;
+      default:
+         return true;
+   }
+}
+
 static void process_frame(comm_channel_t ch, ringbuffer_t* rb) {
    if (rb->index < 2) { // buffer not large enough to be a valid frame
       rb->index = 0;
@@ -158,6 +278,9 @@ static void process_frame(comm_channel_t ch, ringbuffer_t* rb) {
       return;
    }
 
+   // Configuration to modify, writes are staged while a configuration transaction is open
+   pulse_gen_t* const cfg = pulse_gen_config();
+
    switch (cmd) {
       case MSG_ID_REQUEST_VERSION: {
          PROTO_REPLY(ch, MSG_ID_VERSION, SWX_VERSION_PCB_REV, SWX_VERSION_MAJOR, SWX_VERSION_MINOR);
@@ -165,55 +288,72 @@ static void process_frame(comm_channel_t ch, ringbuffer_t* rb) {
       case MSG_ID_REQUEST_ERR: {
          PROTO_REPLY(ch, MSG_ID_ERR, U16_U8(swx_err));
       } break;
+      case MSG_ID_UPDATE_LOOKAHEAD: {
+         uint16_t value = (data[0] << 8) | data[1];
+         cfg->lookahead_us = MIN(value, MAX_LOOKAHEAD_US);
+         LOG_FINE("Update lookahead: value=%u", cfg->lookahead_us);
+      } break;
+      case MSG_ID_REQUEST_LOOKAHEAD: {
+         LOG_FINE("Fetch lookahead: value=%u", cfg->lookahead_us);
+         PROTO_REPLY(ch, MSG_ID_UPDATE_LOOKAHEAD, U16_U8(cfg->lookahead_us));
+      } break;
+      case MSG_ID_CONFIG_BEGIN: {
+         LOG_FINE("Config begin");
+         pulse_gen_begin();
+      } break;
+      case MSG_ID_CONFIG_COMMIT: {
+         LOG_FINE("Config commit");
+         pulse_gen_commit();
+      } break;
+      case MSG_ID_CONFIG_ABORT: {
+         LOG_FINE("Config abort");
+         pulse_gen_abort();
+      } break;
       case MSG_ID_UPDATE_MAX_POWER: {
-         uint8_t ch_mask = data[0];
-
-         uint16_t value = U8_U16(data, 1);
+         ch_mask_t ch_mask = U8_U16(data, 0);
 
-         float pwr = (float)value / UINT16_MAX;
+         uint16_t value = U8_U16(data, 2);
 
          for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
-            if (ch_mask & (1 << ch_index))
-               channels[ch_index].max_power = pwr;
+            if (ch_mask & (1u << ch_index))
+               channels[ch_index].max_power = value;
          }
-         LOG_FINE("Update max_power: ch_mask=%u value=%f", ch_mask, pwr);
+         LOG_FINE("Update max_power: ch_mask=%u value=%u", ch_mask, value);
       } break;
       case MSG_ID_REQUEST_MAX_POWER: {
-         uint8_t ch_mask = data[0];
+         ch_mask_t ch_mask = U8_U16(data, 0);
          for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
-            if (ch_mask & (1 << ch_index)) {
-               float max_power = channels[ch_index].max_power;
+            if (ch_mask & (1u << ch_index)) {
+               uint16_t value = channels[ch_index].max_power;
 
-               LOG_FINE("Fetch max_power: ch=%u value=%f", ch_index, max_power);
+               LOG_FINE("Fetch max_power: ch=%u value=%u", ch_index, value);
 
-               uint16_t value = UINT16_MAX * max_power;
-
-               PROTO_REPLY(ch, MSG_ID_UPDATE_MAX_POWER, (1 << ch_index), U16_U8(value));
+               PROTO_REPLY(ch, MSG_ID_UPDATE_MAX_POWER, U16_U8(1u << ch_index), U16_U8(value));
             }
          }
       } break;
       case MSG_ID_UPDATE_REQUIRE_ZERO: {
-         uint8_t mask = data[0];
+         ch_mask_t mask = U8_U16(data, 0);
          require_zero_mask |= mask;
          LOG_FINE("Update require_zero: value=%u", mask);
       } break;
       case MSG_ID_REQUEST_REQUIRE_ZERO: {
          LOG_FINE("Fetch require_zero: value=%u", require_zero_mask);
-         PROTO_REPLY(ch, MSG_ID_UPDATE_REQUIRE_ZERO, require_zero_mask);
+         PROTO_REPLY(ch, MSG_ID_UPDATE_REQUIRE_ZERO, U16_U8(require_zero_mask));
       } break;
       case MSG_ID_UPDATE_CH_AUDIO: {
-         uint8_t ch_mask = data[0];
-         uint8_t val = data[1];
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         uint8_t val = data[2];
 
          uint8_t audio_src = val & ~AUDIO_MODE_FLAG;
 
          if (audio_src < TOTAL_ANALOG_CHANNELS) {
             for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
-               if (ch_mask & (1 << ch_index)) {
-                  uint8_t* audio = &pulse_gen.channels[ch_index].audio;
+               if (ch_mask & (1u << ch_index)) {
+                  uint8_t* audio = &cfg->channels[ch_index].audio;
 
                   if (*audio != val && audio_src) // require zero if audio src changed
-                     require_zero_mask |= (1 << ch_index);
+                     require_zero_mask |= (1u << ch_index);
 
                   *audio = val;
                }
@@ -222,14 +362,14 @@ static void process_frame(comm_channel_t ch, ringbuffer_t* rb) {
          }
       } break;
       case MSG_ID_REQUEST_CH_AUDIO: {
-         uint8_t ch_mask = data[0];
+         ch_mask_t ch_mask = U8_U16(data, 0);
          for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
-            if (ch_mask & (1 << ch_index)) {
-               uint8_t audio = pulse_gen.channels[ch_index].audio;
+            if (ch_mask & (1u << ch_index)) {
+               uint8_t audio = cfg->channels[ch_index].audio;
 
                LOG_FINE("Fetch audio: ch=%u value=%u", ch_index, audio);
 
-               PROTO_REPLY(ch, MSG_ID_UPDATE_CH_AUDIO, (1 << ch_index), audio);
+               PROTO_REPLY(ch, MSG_ID_UPDATE_CH_AUDIO, U16_U8(1u << ch_index), audio);
             }
          }
       } break;
@@ -268,54 +408,131 @@ static void process_frame(comm_channel_t ch, ringbuffer_t* rb) {
          }
       } break;
       case MSG_ID_UPDATE_CH_EN_MASK: {
-         uint8_t mask = data[0];
-         require_zero_mask |= pulse_gen.en_mask ^ mask; // require zero if enable changed
-         pulse_gen.en_mask = mask;
+         ch_mask_t mask = U8_U16(data, 0);
+         require_zero_mask |= cfg->en_mask ^ mask; // require zero if enable changed
+         config_en_mask_set(mask);
          LOG_FINE("Update en_mask: value=%u", mask);
       } break;
       case MSG_ID_REQUEST_CH_EN_MASK: {
-         LOG_FINE("Fetch en_mask: value=%u", pulse_gen.en_mask);
-         PROTO_REPLY(ch, MSG_ID_UPDATE_CH_EN_MASK, pulse_gen.en_mask);
+         LOG_FINE("Fetch en_mask: value=%u", cfg->en_mask);
+         PROTO_REPLY(ch, MSG_ID_UPDATE_CH_EN_MASK, U16_U8(cfg->en_mask));
       } break;
       case MSG_ID_UPDATE_CH_PARAM: {
-         uint8_t ch_mask = data[0];
-         uint8_t param = data[1] >> 4;
-         uint8_t target = data[1] & 0xf;
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         uint8_t param = data[2] >> 4;
+         uint8_t target = data[2] & 0xf;
 
          if (param < TOTAL_PARAMS && target < TOTAL_TARGETS) {
-            uint16_t value = U8_U16(data, 2);
+            uint16_t value = U8_U16(data, 3);
 
             for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
-               if (ch_mask & (1 << ch_index)) {
-                  if (target != TARGET_MODE && parameter_get(ch_index, param, TARGET_MODE) & TARGET_MODE_FLAG_READONLY)
+               if (ch_mask & (1u << ch_index)) {
+                  if (target != TARGET_MODE && cfg->channels[ch_index].parameters[param][TARGET_MODE] & TARGET_MODE_FLAG_READONLY)
                      continue;
-                  parameter_set(ch_index, param, target, value);
+                  config_parameter_set(ch_index, param, target, value);
                }
             }
 
             LOG_FINE("Update param: ch_mask=%u param=%u target=%u value=%u", ch_mask, param, target, value);
          }
       } break;
+      case MSG_ID_CH_PARAM_RAMP: {
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         uint8_t param = data[2] >> 4;
+         uint8_t target = data[2] & 0xf;
+
+         if (param < TOTAL_PARAMS && target < TOTAL_TARGETS) {
+            uint16_t value = U8_U16(data, 3);
+            uint16_t duration_ms = U8_U16(data, 5);
+
+            for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+               if (ch_mask & (1u << ch_index)) {
+                  if (target != TARGET_MODE && cfg->channels[ch_index].parameters[param][TARGET_MODE] & TARGET_MODE_FLAG_READONLY)
+                     continue;
+
+                  if (pulse_gen_staging()) { // Ramps run on the live generator, so staged writes just take the final value
+                     config_parameter_set(ch_index, param, target, value);
+                  } else {
+                     parameter_ramp(1u << ch_index, param, target, value, duration_ms);
+                  }
+               }
+            }
+
+            LOG_FINE("Ramp param: ch_mask=%u param=%u target=%u value=%u duration=%u", ch_mask, param, target, value, duration_ms);
+         }
+      } break;
       case MSG_ID_REQUEST_CH_PARAM: {
-         uint8_t ch_mask = data[0];
-         uint8_t param = data[1] >> 4;
-         uint8_t target = data[1] & 0xf;
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         uint8_t param = data[2] >> 4;
+         uint8_t target = data[2] & 0xf;
 
          if (param < TOTAL_PARAMS && target < TOTAL_TARGETS) {
             for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
-               if (ch_mask & (1 << ch_index)) {
-                  uint16_t value = parameter_get(ch_index, param, target);
+               if (ch_mask & (1u << ch_index)) {
+                  uint16_t value = cfg->channels[ch_index].parameters[param][target];
 
                   LOG_FINE("Fetch param: ch=%u param=%u target=%u value=%u", ch_index, param, target, value);
 
-                  PROTO_REPLY(ch, MSG_ID_UPDATE_CH_PARAM, (1 << ch_index), data[1], U16_U8(value));
+                  PROTO_REPLY(ch, MSG_ID_UPDATE_CH_PARAM, U16_U8(1u << ch_index), data[2], U16_U8(value));
                }
             }
          }
       } break;
+      case MSG_ID_UPDATE_MORPH_BANK: {
+         uint8_t bank = data[0];
+         ch_mask_t ch_mask = U8_U16(data, 1);
+         uint8_t param = data[3] >> 4;
+         uint8_t target = data[3] & 0xf;
+
+         if (bank < MORPH_BANKS && param < TOTAL_PARAMS && target < TOTAL_TARGETS) {
+            uint16_t value = U8_U16(data, 4);
+
+            for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+               if (ch_mask & (1u << ch_index))
+                  morph_bank_set(bank, ch_index, param, target, value);
+            }
+
+            LOG_FINE("Update morph bank: bank=%u ch_mask=%u param=%u target=%u value=%u", bank, ch_mask, param, target, value);
+         }
+      } break;
+      case MSG_ID_REQUEST_MORPH_BANK: {
+         uint8_t bank = data[0];
+         ch_mask_t ch_mask = U8_U16(data, 1);
+         uint8_t param = data[3] >> 4;
+         uint8_t target = data[3] & 0xf;
+
+         if (bank < MORPH_BANKS && param < TOTAL_PARAMS && target < TOTAL_TARGETS) {
+            for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+               if (ch_mask & (1u << ch_index)) {
+                  uint16_t value = cfg->morph.banks[bank][ch_index][param][target];
+
+                  LOG_FINE("Fetch morph bank: bank=%u ch=%u param=%u target=%u value=%u", bank, ch_index, param, target, value);
+
+                  PROTO_REPLY(ch, MSG_ID_UPDATE_MORPH_BANK, bank, U16_U8(1u << ch_index), data[3], U16_U8(value));
+               }
+            }
+         }
+      } break;
+      case MSG_ID_MORPH_CAPTURE: {
+         uint8_t bank = data[0];
+         if (bank < MORPH_BANKS) {
+            morph_bank_capture(bank);
+            LOG_FINE("Capture morph bank: bank=%u", bank);
+         }
+      } break;
+      case MSG_ID_UPDATE_MORPH: {
+         bool en = !!data[0];
+         uint16_t position = U8_U16(data, 1);
+         morph_set(en, position);
+         LOG_FINE("Update morph: en=%u position=%u", en, position);
+      } break;
+      case MSG_ID_REQUEST_MORPH: {
+         LOG_FINE("Fetch morph: en=%u position=%u", cfg->morph.enabled, cfg->morph.position);
+         PROTO_REPLY(ch, MSG_ID_UPDATE_MORPH, cfg->morph.enabled, U16_U8(cfg->morph.position));
+      } break;
       case MSG_ID_CH_PARAM_UPDATE: {
-         uint8_t ch_mask = data[0];
-         uint8_t param = data[1];
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         uint8_t param = data[2];
 
          uint8_t pstart = param;
          uint8_t pend = param + 1;
@@ -329,7 +546,7 @@ static void process_frame(comm_channel_t ch, ringbuffer_t* rb) {
 
             for (uint8_t i = pstart; i < pend; i++) {
                for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
-                  if (ch_mask & (1 << ch_index))
+                  if (ch_mask & (1u << ch_index))
                      parameter_update(ch_index, i);
                }
                LOG_FINE("Param update: ch_mask=%u param=%u", ch_mask, i);
@@ -337,15 +554,15 @@ static void process_frame(comm_channel_t ch, ringbuffer_t* rb) {
          }
       } break;
       case MSG_ID_REQUEST_CH_STATUS: {
-         uint8_t ch_mask = data[0];
+         ch_mask_t ch_mask = U8_U16(data, 0);
 
          for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
-            if (ch_mask & (1 << ch_index)) {
+            if (ch_mask & (1u << ch_index)) {
                channel_status_t status = channels[ch_index].status;
 
                LOG_FINE("Fetch status: ch=%u value=%u", ch_index, status);
 
-               PROTO_REPLY(ch, MSG_ID_CH_STATUS, (1 << ch_index), status);
+               PROTO_REPLY(ch, MSG_ID_CH_STATUS, U16_U8(1u << ch_index), status);
             }
          }
       } break;
@@ -358,43 +575,47 @@ static void process_frame(comm_channel_t ch, ringbuffer_t* rb) {
          if (count > MAX_SEQUENCES)
             count = MAX_SEQUENCES;
 
-         memcpy(pulse_gen.sequencer.masks, &data[2], count);
+         for (size_t i = 0; i < count; i++)
+            cfg->sequencer.masks[i] = U8_U16(data, 2 + (i * 2));
 
          if (wrap)
-            pulse_gen.sequencer.count = count;
+            cfg->sequencer.count = count;
 
          LOG_FINE("Update seq: count=%u wrap=%u", count, wrap);
       } break;
       case MSG_ID_REQUEST_SEQ: {
-         uint8_t msg[4 + MAX_SEQUENCES] = {MSG_FRAME_START, MSG_ID_UPDATE_SEQ, false, MAX_SEQUENCES};
+         uint8_t msg[4 + (MAX_SEQUENCES * 2)] = {MSG_FRAME_START, MSG_ID_UPDATE_SEQ, false, MAX_SEQUENCES};
 
-         memcpy(&msg[4], pulse_gen.sequencer.masks, MAX_SEQUENCES);
+         for (size_t i = 0; i < MAX_SEQUENCES; i++) {
+            msg[4 + (i * 2)] = cfg->sequencer.masks[i] >> 8;
+            msg[5 + (i * 2)] = cfg->sequencer.masks[i] & 0xff;
+         }
 
          protocol_write_frame(ch, msg, sizeof(msg));
       } break;
       case MSG_ID_UPDATE_SEQ_COUNT: {
          uint8_t count = data[0];
-         pulse_gen.sequencer.count = count;
+         cfg->sequencer.count = count;
          LOG_FINE("Update seq: count=%u", count);
       } break;
       case MSG_ID_REQUEST_SEQ_COUNT: {
-         uint8_t count = pulse_gen.sequencer.count;
+         uint8_t count = cfg->sequencer.count;
          LOG_FINE("Fetch seq: count=%u", count);
          PROTO_REPLY(ch, MSG_ID_UPDATE_SEQ_COUNT, count);
       } break;
       case MSG_ID_RESET_SEQ_INDEX: {
-         LOG_FINE("Reset seq: index=%u", pulse_gen.sequencer.index);
-         pulse_gen.sequencer.index = 0;
+         LOG_FINE("Reset seq: index=%u", cfg->sequencer.index);
+         config_sequencer_index_set(0);
       } break;
       case MSG_ID_UPDATE_SEQ_PERIOD: {
          uint16_t period_ms = U8_U16(data, 0);
 
-         pulse_gen.sequencer.period_us = period_ms * 1000u;
+         cfg->sequencer.period_us = period_ms * 1000u;
 
          LOG_FINE("Update seq_period: value=%u", period_ms);
       } break;
       case MSG_ID_REQUEST_SEQ_PERIOD: {
-         uint16_t period_ms = pulse_gen.sequencer.period_us / 1000u;
+         uint16_t period_ms = cfg->sequencer.period_us / 1000u;
 
          LOG_FINE("Fetch seq_period: value=%u", period_ms);
 
@@ -404,34 +625,189 @@ static void process_frame(comm_channel_t ch, ringbuffer_t* rb) {
          uint8_t a_index = data[0];
          bool en = !!data[1];
          uint8_t type = data[2];
-         uint8_t ch_mask = data[3];
-         uint8_t param = data[4];
-         uint8_t target = data[5];
+         ch_mask_t ch_mask = U8_U16(data, 3);
+         uint8_t param = data[5];
+         uint8_t target = data[6];
          if (a_index < MAX_ACTIONS && param < TOTAL_PARAMS && target < TOTAL_TARGETS) {
-            uint16_t value = U8_U16(data, 6);
-
-            action_t* action = &pulse_gen.actions[a_index];
-            action->enabled = en;
-            action->type = type;
-            action->ch_mask = ch_mask;
-            action->param = param;
-            action->target = target;
-            action->value = value;
-
-            LOG_FINE("Update action: index=%u en=%u type=%u ch_mask=%u param=%u target=%u value=%u", a_index, en, type, ch_mask, param, target, value);
+            uint16_t value = U8_U16(data, 7);
+            uint16_t duration_ms = (ret.out_len - 2) >= 11 ? U8_U16(data, 9) : 0; // Duration is optional, -2 for MSG_FRAME_START and cmd byte
+
+            action_t action = {
+                .enabled = en,
+                .type = type,
+                .ch_mask = ch_mask,
+                .param = param,
+                .target = target,
+                .value = value,
+                .duration_ms = duration_ms,
+            };
+
+            if (action_set(a_index, &action))
+               LOG_FINE("Update action: index=%u en=%u type=%u ch_mask=%u param=%u target=%u value=%u duration=%u", a_index, en, type, ch_mask, param, target, value,
+                        duration_ms);
          }
       } break;
       case MSG_ID_REQUEST_ACTION: {
          uint8_t a_index = data[0];
          if (a_index < MAX_ACTIONS) {
-            action_t* action = &pulse_gen.actions[a_index];
+            action_t* action = &cfg->actions[a_index];
 
-            LOG_FINE("Fetch action: index=%u en=%u type=%u ch_mask=%u param=%u target=%u value=%u", a_index, action->enabled, action->type, action->ch_mask,
-                     action->param, action->target, action->value);
+            LOG_FINE("Fetch action: index=%u en=%u type=%u ch_mask=%u param=%u target=%u value=%u duration=%u", a_index, action->enabled, action->type, action->ch_mask,
+                     action->param, action->target, action->value, action->duration_ms);
 
-            PROTO_REPLY(ch, MSG_ID_UPDATE_ACTION, a_index, action->enabled, action->type, action->ch_mask, action->param, action->target, U16_U8(action->value));
+            PROTO_REPLY(ch, MSG_ID_UPDATE_ACTION, a_index, action->enabled, action->type, U16_U8(action->ch_mask), action->param, action->target, U16_U8(action->value),
+                        U16_U8(action->duration_ms));
          }
       } break;
+      case MSG_ID_UPDATE_MOD_ROUTE: {
+         uint8_t r_index = data[0];
+
+         mod_route_t route = {
+             .source = data[1],
+             .source_index = data[2],
+             .source_param = data[3],
+             .ch_mask = U8_U16(data, 4),
+             .param = data[6],
+             .target = data[7],
+             .offset = U8_U16(data, 8),
+             .depth = (int16_t)U8_U16(data, 10),
+         };
+
+         if (mod_route_set(r_index, &route)) {
+            LOG_FINE("Update mod route: index=%u source=%u src_index=%u src_param=%u ch_mask=%u param=%u target=%u offset=%u depth=%d", r_index, route.source,
+                     route.source_index, route.source_param, route.ch_mask, route.param, route.target, route.offset, route.depth);
+         } else {
+            LOG_WARN("Invalid mod route: index=%u source=%u", r_index, route.source);
+         }
+      } break;
+      case MSG_ID_REQUEST_MOD_ROUTE: {
+         uint8_t r_index = data[0];
+         if (r_index < MAX_MOD_ROUTES) {
+            mod_route_t* route = &cfg->mod_routes[r_index];
+
+            LOG_FINE("Fetch mod route: index=%u source=%u src_index=%u src_param=%u ch_mask=%u param=%u target=%u offset=%u depth=%d", r_index, route->source,
+                     route->source_index, route->source_param, route->ch_mask, route->param, route->target, route->offset, route->depth);
+
+            PROTO_REPLY(ch, MSG_ID_UPDATE_MOD_ROUTE, r_index, route->source, route->source_index, route->source_param, U16_U8(route->ch_mask), route->param, route->target,
+                        U16_U8(route->offset), U16_U8((uint16_t)route->depth));
+         }
+      } break;
+      case MSG_ID_UPDATE_CH_POWER_MODE: {
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         uint8_t mode = data[2];
+
+         if (mode < TOTAL_POWER_MODES) {
+            for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+               if (ch_mask & (1u << ch_index))
+                  cfg->channels[ch_index].power_mode = mode;
+            }
+            LOG_FINE("Update power_mode: ch_mask=%u value=%u", ch_mask, mode);
+         }
+      } break;
+      case MSG_ID_REQUEST_CH_POWER_MODE: {
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+            if (ch_mask & (1u << ch_index)) {
+               uint8_t mode = cfg->channels[ch_index].power_mode;
+
+               LOG_FINE("Fetch power_mode: ch=%u value=%u", ch_index, mode);
+
+               PROTO_REPLY(ch, MSG_ID_UPDATE_CH_POWER_MODE, U16_U8(1u << ch_index), mode);
+            }
+         }
+      } break;
+      case MSG_ID_UPDATE_CH_POWER_LUT: {
+         ch_mask_t ch_mask = U8_U16(data, 0);
+
+         for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+            if (ch_mask & (1u << ch_index)) {
+               for (size_t i = 0; i <= POWER_LUT_SIZE; i++)
+                  cfg->channels[ch_index].power_lut[i] = U8_U16(data, 2 + (i * 2));
+            }
+         }
+         LOG_FINE("Update power_lut: ch_mask=%u", ch_mask);
+      } break;
+      case MSG_ID_REQUEST_CH_POWER_LUT: {
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+            if (ch_mask & (1u << ch_index)) {
+               LOG_FINE("Fetch power_lut: ch=%u", ch_index);
+
+               uint8_t msg[4 + ((POWER_LUT_SIZE + 1) * 2)] = {MSG_FRAME_START, MSG_ID_UPDATE_CH_POWER_LUT, U16_U8(1u << ch_index)};
+               for (size_t i = 0; i <= POWER_LUT_SIZE; i++) {
+                  msg[4 + (i * 2)] = cfg->channels[ch_index].power_lut[i] >> 8;
+                  msg[5 + (i * 2)] = cfg->channels[ch_index].power_lut[i] & 0xff;
+               }
+               protocol_write_frame(ch, msg, sizeof(msg));
+            }
+         }
+      } break;
+      case MSG_ID_UPDATE_TIMELINE_STEP: {
+         uint8_t s_index = data[0];
+
+         timeline_step_t step = {
+             .duration_ms = U8_U16(data, 1),
+             .fade_ms = U8_U16(data, 3),
+             .en_mask = U8_U16(data, 5),
+             .scene_start = data[7],
+             .scene_count = data[8],
+         };
+
+         if (timeline_step_set(s_index, &step)) {
+            LOG_FINE("Update timeline step: index=%u duration_ms=%u fade_ms=%u en_mask=%u scene=%u+%u", s_index, step.duration_ms, step.fade_ms, step.en_mask,
+                     step.scene_start, step.scene_count);
+         } else {
+            LOG_WARN("Invalid timeline step: index=%u scene=%u+%u", s_index, step.scene_start, step.scene_count);
+         }
+      } break;
+      case MSG_ID_REQUEST_TIMELINE_STEP: {
+         uint8_t s_index = data[0];
+         if (s_index < MAX_TIMELINE_STEPS) {
+            timeline_step_t* step = &cfg->timeline.steps[s_index];
+
+            LOG_FINE("Fetch timeline step: index=%u duration_ms=%u fade_ms=%u en_mask=%u scene=%u+%u", s_index, step->duration_ms, step->fade_ms, step->en_mask,
+                     step->scene_start, step->scene_count);
+
+            PROTO_REPLY(ch, MSG_ID_UPDATE_TIMELINE_STEP, s_index, U16_U8(step->duration_ms), U16_U8(step->fade_ms), U16_U8(step->en_mask), step->scene_start,
+                        step->scene_count);
+         }
+      } break;
+      case MSG_ID_UPDATE_SCENE_ENTRY: {
+         uint8_t e_index = data[0];
+
+         scene_entry_t entry = {
+             .ch_mask = U8_U16(data, 1),
+             .param = data[3],
+             .target = data[4],
+             .value = U8_U16(data, 5),
+         };
+
+         if (scene_entry_set(e_index, &entry)) {
+            LOG_FINE("Update scene entry: index=%u ch_mask=%u param=%u target=%u value=%u", e_index, entry.ch_mask, entry.param, entry.target, entry.value);
+         } else {
+            LOG_WARN("Invalid scene entry: index=%u param=%u target=%u", e_index, entry.param, entry.target);
+         }
+      } break;
+      case MSG_ID_REQUEST_SCENE_ENTRY: {
+         uint8_t e_index = data[0];
+         if (e_index < MAX_SCENE_ENTRIES) {
+            scene_entry_t* entry = &cfg->timeline.scenes[e_index];
+
+            LOG_FINE("Fetch scene entry: index=%u ch_mask=%u param=%u target=%u value=%u", e_index, entry->ch_mask, entry->param, entry->target, entry->value);
+
+            PROTO_REPLY(ch, MSG_ID_UPDATE_SCENE_ENTRY, e_index, U16_U8(entry->ch_mask), entry->param, entry->target, U16_U8(entry->value));
+         }
+      } break;
+      case MSG_ID_UPDATE_TIMELINE_COUNT: {
+         uint8_t count = data[0];
+         timeline_count_set(count);
+         LOG_FINE("Update timeline: count=%u", count);
+      } break;
+      case MSG_ID_REQUEST_TIMELINE_COUNT: {
+         uint8_t count = cfg->timeline.count;
+         LOG_FINE("Fetch timeline: count=%u", count);
+         PROTO_REPLY(ch, MSG_ID_UPDATE_TIMELINE_COUNT, count);
+      } break;
       case MSG_ID_RUN_ACTION_LIST: {
          uint8_t al_start = data[0];
          uint8_t al_end = data[1];
@@ -442,6 +818,65 @@ static void process_frame(comm_channel_t ch, ringbuffer_t* rb) {
             execute_action_list(al_start, al_end);
          }
       } break;
+      case MSG_ID_UPDATE_CH_RAMP_CURVE: {
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         uint8_t curve = data[2];
+
+         if (curve < TOTAL_RAMP_CURVES) {
+            for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+               if (ch_mask & (1u << ch_index))
+                  cfg->channels[ch_index].ramp_curve = curve;
+            }
+            LOG_FINE("Update ramp_curve: ch_mask=%u value=%u", ch_mask, curve);
+         }
+      } break;
+      case MSG_ID_REQUEST_CH_RAMP_CURVE: {
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+            if (ch_mask & (1u << ch_index)) {
+               uint8_t curve = cfg->channels[ch_index].ramp_curve;
+
+               LOG_FINE("Fetch ramp_curve: ch=%u value=%u", ch_index, curve);
+
+               PROTO_REPLY(ch, MSG_ID_UPDATE_CH_RAMP_CURVE, U16_U8(1u << ch_index), curve);
+            }
+         }
+      } break;
+      case MSG_ID_UPDATE_CH_WAVEFORM: {
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         uint8_t flags = data[2];
+         uint16_t neg_width_us = U8_U16(data, 3);
+         uint8_t gap_us = data[5];
+         uint8_t burst_count = data[6];
+         uint16_t burst_period_us = U8_U16(data, 7);
+
+         for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+            if (ch_mask & (1u << ch_index)) {
+               cfg->channels[ch_index].waveform.flags = flags;
+               cfg->channels[ch_index].waveform.neg_width_us = neg_width_us;
+               cfg->channels[ch_index].waveform.gap_us = gap_us;
+               cfg->channels[ch_index].waveform.burst_count = burst_count;
+               cfg->channels[ch_index].waveform.burst_period_us = burst_period_us;
+            }
+         }
+         LOG_FINE("Update waveform: ch_mask=%u flags=%u neg=%u gap=%u count=%u period=%u", ch_mask, flags, neg_width_us, gap_us, burst_count, burst_period_us);
+      } break;
+      case MSG_ID_REQUEST_CH_WAVEFORM: {
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+            if (ch_mask & (1u << ch_index)) {
+               uint8_t flags = cfg->channels[ch_index].waveform.flags;
+               uint16_t neg_width_us = cfg->channels[ch_index].waveform.neg_width_us;
+               uint8_t gap_us = cfg->channels[ch_index].waveform.gap_us;
+               uint8_t burst_count = cfg->channels[ch_index].waveform.burst_count;
+               uint16_t burst_period_us = cfg->channels[ch_index].waveform.burst_period_us;
+
+               LOG_FINE("Fetch waveform: ch=%u flags=%u neg=%u gap=%u count=%u period=%u", ch_index, flags, neg_width_us, gap_us, burst_count, burst_period_us);
+
+               PROTO_REPLY(ch, MSG_ID_UPDATE_CH_WAVEFORM, U16_U8(1u << ch_index), flags, U16_U8(neg_width_us), gap_us, burst_count, U16_U8(burst_period_us));
+            }
+         }
+      } break;
       case MSG_ID_UPDATE_TRIGGER: {
          uint8_t trig_index = data[0];
 
@@ -473,7 +908,7 @@ static void process_frame(comm_channel_t ch, ringbuffer_t* rb) {
             trigger->op = op;
             trigger->threshold_invert = threshold_invert;
             trigger->require_both = require_both;
-            trigger->threshold = (float)threshold / UINT16_MAX;
+            trigger->threshold = threshold;
             trigger->repeating = repeating;
             trigger->min_period_us = min_period_ms * 1000u;
             trigger->action_start_index = al_start;
@@ -491,7 +926,7 @@ static void process_frame(comm_channel_t ch, ringbuffer_t* rb) {
             trigger_t* trigger = &triggers[trig_index];
 
             uint16_t min_period_ms = trigger->min_period_us / 1000u;
-            uint16_t threshold = MIN(trigger->threshold, 1.0f) * UINT16_MAX;
+            uint16_t threshold = trigger->threshold;
 
             LOG_FINE("Fetch trigger: index=%u iim=%u im=%u repeat=%u inv=%u op=%u min_period_ms=%u al=%u-%u", trig_index, trigger->input_invert_mask, trigger->input_mask,
                      trigger->repeating, trigger->output_invert, trigger->op, min_period_ms, trigger->action_start_index, trigger->action_end_index);
@@ -508,6 +943,171 @@ static void process_frame(comm_channel_t ch, ringbuffer_t* rb) {
          LOG_FINE("Fetch trigger input: state=%u", trig_input_states);
          PROTO_REPLY(ch, MSG_ID_TRIGGER_STATE, trig_input_states);
       } break;
+      case MSG_ID_REQUEST_TIMER_STATS: {
+         bool reset = !!data[0];
+
+         const timer_wheel_stats_t* stats = timer_wheel_stats();
+
+         LOG_FINE("Fetch timer stats: occupancy=%u/%u peak=%u overflows=%u expired=%u max_late_us=%u", stats->occupancy, stats->capacity, stats->peak_occupancy,
+                  stats->overflows, stats->expired, stats->max_late_us);
+
+         PROTO_REPLY(ch, MSG_ID_TIMER_STATS, stats->capacity, stats->occupancy, stats->peak_occupancy, U32_U8(stats->overflows), U32_U8(stats->expired),
+                     U32_U8(stats->max_late_us));
+
+         if (reset)
+            timer_wheel_stats_reset();
+      } break;
+      case MSG_ID_UPDATE_CH_FREQ_FRAC: {
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         uint8_t frac = data[2];
+
+         for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+            if (ch_mask & (1u << ch_index))
+               cfg->channels[ch_index].frequency_frac = frac;
+         }
+         LOG_FINE("Update frequency_frac: ch_mask=%u value=%u", ch_mask, frac);
+      } break;
+      case MSG_ID_REQUEST_CH_FREQ_FRAC: {
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+            if (ch_mask & (1u << ch_index)) {
+               uint8_t frac = cfg->channels[ch_index].frequency_frac;
+
+               LOG_FINE("Fetch frequency_frac: ch=%u value=%u", ch_index, frac);
+
+               PROTO_REPLY(ch, MSG_ID_UPDATE_CH_FREQ_FRAC, U16_U8(1u << ch_index), frac);
+            }
+         }
+      } break;
+      case MSG_ID_UPDATE_CH_GROUP: {
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         uint8_t group = data[2];
+         uint16_t phase = U8_U16(data, 3);
+
+         if (group > MAX_GROUPS) {
+            LOG_WARN("Invalid channel group: ch_mask=%u group=%u", ch_mask, group);
+            break;
+         }
+
+         for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+            if (ch_mask & (1u << ch_index)) {
+               cfg->channels[ch_index].group = group;
+               cfg->channels[ch_index].phase = phase;
+            }
+         }
+         LOG_FINE("Update group: ch_mask=%u group=%u phase=%u", ch_mask, group, phase);
+      } break;
+      case MSG_ID_REQUEST_CH_GROUP: {
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+            if (ch_mask & (1u << ch_index)) {
+               uint8_t group = cfg->channels[ch_index].group;
+               uint16_t phase = cfg->channels[ch_index].phase;
+
+               LOG_FINE("Fetch group: ch=%u group=%u phase=%u", ch_index, group, phase);
+
+               PROTO_REPLY(ch, MSG_ID_UPDATE_CH_GROUP, U16_U8(1u << ch_index), group, U16_U8(phase));
+            }
+         }
+      } break;
+      case MSG_ID_REQUEST_CH_RATE: {
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+            if (ch_mask & (1u << ch_index)) {
+               rate_stats_t stats;
+               pulse_gen_rate(ch_index, &stats);
+
+               LOG_FINE("Fetch rate: ch=%u freq_q8=%u measured_q8=%u error_ppm=%d resyncs=%u", ch_index, stats.freq_q8, stats.measured_freq_q8, stats.error_ppm,
+                        stats.resyncs);
+
+               PROTO_REPLY(ch, MSG_ID_CH_RATE, U16_U8(1u << ch_index), U32_U8(stats.freq_q8), U32_U8(stats.measured_freq_q8), U32_U8((uint32_t)stats.error_ppm),
+                           U32_U8(stats.resyncs));
+            }
+         }
+      } break;
+      case MSG_ID_REQUEST_CH_PREVIEW: {
+         ch_mask_t ch_mask = U8_U16(data, 0);
+         uint32_t window_us = U8_U16(data, 2) * 1000u;
+
+         // Too large for the stack, replies are written one at a time so these can be shared
+         static preview_channel_t preview;
+         static preview_event_t events[PREVIEW_MAX_EVENTS];
+         static uint8_t msg[9 + (PREVIEW_MAX_EVENTS * 7)] = {MSG_FRAME_START, MSG_ID_CH_PREVIEW};
+         static_assert(sizeof(msg) <= MSG_SIZE);
+
+         for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+            if (ch_mask & (1u << ch_index)) {
+               pulse_gen_preview(ch_index, &preview);
+
+               uint32_t covered_us;
+               const size_t count = preview_run(&preview, window_us, events, PREVIEW_MAX_EVENTS, &covered_us);
+
+               LOG_FINE("Fetch preview: ch=%u window=%u covered=%u count=%u", ch_index, window_us, covered_us, count);
+
+               msg[2] = (1u << ch_index) >> 8;
+               msg[3] = (1u << ch_index) & 0xff;
+               msg[4] = covered_us >> 24;
+               msg[5] = (covered_us >> 16) & 0xff;
+               msg[6] = (covered_us >> 8) & 0xff;
+               msg[7] = covered_us & 0xff;
+               msg[8] = count;
+
+               for (size_t i = 0; i < count; i++) {
+                  uint8_t* const event = &msg[9 + (i * 7)];
+                  event[0] = events[i].time_us >> 24;
+                  event[1] = (events[i].time_us >> 16) & 0xff;
+                  event[2] = (events[i].time_us >> 8) & 0xff;
+                  event[3] = events[i].time_us & 0xff;
+                  event[4] = events[i].type;
+                  event[5] = events[i].value >> 8;
+                  event[6] = events[i].value & 0xff;
+               }
+
+               protocol_write_frame(ch, msg, 9 + (count * 7));
+            }
+         }
+      } break;
+      case MSG_ID_UPDATE_VM_PROGRAM: {
+         uint16_t addr = U8_U16(data, 0);
+         size_t len = ret.out_len - 4; // -4 for MSG_FRAME_START, cmd byte, and address
+
+         if (addr + len <= VM_PROGRAM_SIZE) {
+            vm_stop(0xff); // Stop threads, since instructions might change under them
+            memcpy(&vm_program[addr], &data[2], len);
+
+            LOG_FINE("Update vm_program: addr=%u len=%u", addr, len);
+         }
+      } break;
+      case MSG_ID_VM_START: {
+         uint8_t thread_index = data[0];
+         uint16_t addr = U8_U16(data, 1);
+
+         if (vm_start(thread_index, addr))
+            LOG_FINE("Start vm thread: index=%u addr=%u", thread_index, addr);
+      } break;
+      case MSG_ID_VM_STOP: {
+         uint8_t thread_mask = data[0];
+
+         vm_stop(thread_mask);
+
+         LOG_FINE("Stop vm threads: mask=%u", thread_mask);
+      } break;
+      case MSG_ID_REQUEST_VM_STATE: {
+         uint8_t thread_index = data[0];
+
+         if (thread_index < VM_THREADS) {
+            const vm_thread_t* thread = &vm_threads[thread_index];
+
+            LOG_FINE("Fetch vm state: index=%u state=%u pc=%u", thread_index, thread->state, thread->pc);
+
+            uint8_t msg[6 + (VM_REGISTERS * 2)] = {MSG_FRAME_START, MSG_ID_VM_STATE, thread_index, thread->state, U16_U8(thread->pc)};
+            for (size_t i = 0; i < VM_REGISTERS; i++) {
+               msg[6 + (i * 2)] = thread->regs[i] >> 8;
+               msg[7 + (i * 2)] = thread->regs[i] & 0xff;
+            }
+            protocol_write_frame(ch, msg, sizeof(msg));
+         }
+      } break;
       case MSG_ID_SHUTDOWN: {
          swx_power_off();
       } break;
@@ -534,6 +1134,10 @@ static void process_frame(comm_channel_t ch, ringbuffer_t* rb) {
          LOG_WARN("Unknown message: id=%u", cmd);
       } break;
    }
+
+   // Frame might have changed the generator configuration, so re-evaluate deadlines. Requests don't, so polling doesn't cost a full pass.
+   if (command_writes(cmd))
+      pulse_gen_reschedule();
 }
 
 static inline bool rb_push(ringbuffer_t* rb, char c) {
@@ -22,6 +22,7 @@
 
 #define U16_U8(value) ((value) >> 8), ((value) & 0xff)
 #define U8_U16(arr, i) ((arr[(i)] << 8) | arr[((i) + 1)])
+#define U32_U8(value) U16_U8((value) >> 16), U16_U8((value) & 0xffff)
 
 #define PROTO_REPLY(ch, id, ...)                                                                                                                                         \
    do {                                                                                                                                                                  \
@@ -17,10 +17,50 @@
  */
 #include "pulse_gen.h"
 
+#include <math.h>
+
+#include <hardware/timer.h>
+
 #include "output.h"
+#include "analog_capture.h"
+#include "trigger.h"
+#include "util/pulse_math.h"
 
-#define STATE_COUNT (4)
 #define MAX_FREQUENCY_HZ (500) // pulse generation frequency limit
+#define MAX_FREQ_Q8 ((MAX_FREQUENCY_HZ * 10u) << 8) // MAX_FREQUENCY_HZ in dHz (Q8), see derived_t
+
+#define POWER_UPDATE_PERIOD_US (55 * CHANNEL_COUNT)  // DAC fast write takes about ~55us/ch, channels sharing a DAC are written together
+#define AUDIO_POLL_PERIOD_US (1000)                  // How often audio sources are checked for new sample buffers
+#define SCHED_IDLE_PERIOD_US (1000000)               // Longest time between processing a slot when nothing is due
+#define RATE_WINDOW_US (1000000)                     // Measurement window for the pulse rate error
+#define LOOKAHEAD_GUARD_US (250)                     // Queued pulses sooner than this might already be output, so invalidation keeps them
+
+#define RAMP_CURVE_EXP_K (5.0f)  // Steepness of RAMP_CURVE_EXPONENTIAL
+#define RAMP_CURVE_LOG_K (20.0f) // Steepness of RAMP_CURVE_LOGARITHMIC
+
+#define LFO_TABLE_BITS (8)
+#define LFO_TABLE_SIZE (1 << LFO_TABLE_BITS) // Number of segments in the LFO wavetable
+#define LFO_FRAC_BITS (16 - LFO_TABLE_BITS)  // Phase bits used for interpolating between table entries
+#define LFO_UPDATE_PERIOD_US (1000)          // How often LFO parameters are evaluated
+
+#define SWEEP_MAX_CATCH_UP_US (100000) // Sweeps further behind than this (e.g. channel was disabled) restart from now instead of catching up
+
+#define SCHED_SLOT_SEQUENCER (CHANNEL_COUNT)    // Scheduler slot for the sequencer, channels use their index as the slot
+#define SCHED_SLOT_TIMERS (CHANNEL_COUNT + 1)   // Scheduler slot for the deferred action timer wheel
+#define SCHED_SLOT_MOD (CHANNEL_COUNT + 2)      // Scheduler slot for the modulation matrix
+#define SCHED_SLOT_TIMELINE (CHANNEL_COUNT + 3) // Scheduler slot for the timeline
+#define SCHED_SLOT_FADE (CHANNEL_COUNT + 4)     // Scheduler slot for parameter fades
+#define SCHED_SLOTS (CHANNEL_COUNT + 5)
+
+#define TIMER_WHEEL_SLOTS (64)       // Number of wheel buckets, timers hash into a bucket by expiry tick
+#define TIMER_WHEEL_TICK_US (1000)   // Wheel resolution
+#define TIMER_WHEEL_NONE (UINT8_MAX) // Null timer index for bucket and free lists
+
+#define ACTION_CACHE_SIZE (16)     // Number of compiled action lists kept
+#define ACTION_CACHE_MAX_OPS (64)  // Maximum number of ops in a compiled action list (after inlining ACTION_EXECUTE)
+#define ACTION_CACHE_MAX_DEPTH (8) // Maximum ACTION_EXECUTE nesting depth inlined into a compiled action list
+
+static_assert(STATE_COUNT == TOTAL_PREVIEW_STATES); // Ensure previews follow the same state sequence
 
 // Pulse generation power fade-in/fade-out transition sequence
 static const param_t STATE_SEQUENCE[STATE_COUNT] = {
@@ -30,245 +70,1747 @@ static const param_t STATE_SEQUENCE[STATE_COUNT] = {
     PARAM_OFF_TIME,
 };
 
-typedef struct {
-   int8_t step; // Number of steps to increment/decrement per parameter update.
+// The derived_t values (derived value bits) depending on each parameter value, state times are in STATE_SEQUENCE order
+static const uint8_t DERIVED_PARAM_BITS[TOTAL_PARAMS] = {
+    [PARAM_FREQUENCY] = (1 << DERIVED_FREQ),
+    [PARAM_ON_RAMP_TIME] = (1 << 0),
+    [PARAM_ON_TIME] = (1 << 1),
+    [PARAM_OFF_RAMP_TIME] = (1 << 2),
+    [PARAM_OFF_TIME] = (1 << 3),
+};
+
+typedef struct {
+   int8_t step;  // Number of steps to increment/decrement per parameter update.
+   uint8_t mode; // The mode step was computed for (without flag and skew bits), see TARGET_MODE.
+
+   uint32_t next_update_time_us; // The absolute timestamp of the next ideal parameter step update.
+
+   frac_period_t update_period; // Parameter step update period, fractions are accumulated so the average sweep rate is exact over long runs.
+
+   uint32_t phase;       // LFO cycle phase (Q32), see TARGET_MODE_SINE.
+   uint32_t phase_inc;   // LFO phase increment per update (Q32).
+   uint16_t random_from; // TARGET_MODE_RANDOM value at the start of the cycle (fraction of UINT16_MAX).
+   uint16_t random_to;   // TARGET_MODE_RANDOM value at the end of the cycle (fraction of UINT16_MAX).
+} parameter_t;
+
+static_assert(TOTAL_PARAMS <= 8);  // Ensure parameters fit in generator_t.sweep_mask
+static_assert(TOTAL_TARGETS <= 8); // Ensure targets fit in pulse_gen_t.morph.captured
+static_assert(SCHED_SLOTS <= 32);  // Ensure slots fit in sched_marked
+
+typedef struct {
+   bool running;        // True if the channel was enabled during the last update.
+   uint8_t state_index; // The current "waveform" state (e.g. off, on_ramp, on).
+
+   uint32_t last_power_time_us; // The absolute timestamp since the last power update occurred.
+   uint32_t last_pulse_time_us; // The absolute timestamp since the last pulse occurred.
+   nco_t pulse_nco;             // Pulse timebase.
+   uint32_t pulse_freq_q8;      // The frequency pulse_nco was configured for (dHz, Q8).
+   uint32_t rate_time_us;       // The absolute timestamp the current rate measurement window started.
+   uint16_t rate_count;         // Number of pulses in the current rate measurement window.
+   uint32_t measured_freq_q8;   // Measured pulse frequency over the last window (dHz, Q8).
+   bool group_synced;           // True if group_seq tracks the group timebase.
+   uint32_t group_seq;          // The last group timebase event a pulse was generated for.
+   bool negative;               // True if the next pulse starts with the negative phase, used by WAVEFORM_FLAG_ALTERNATE.
+   pulse_t planned;             // The shape queued lookahead pulses were planned with (abs_time_us unused).
+
+   uint32_t last_state_time_us; // The absolute timestamp since the last "waveform" state change (e.g. off -> on_ramp -> on).
+
+   bool ramp_built;                          // True if ramp_table has been built for ramp_curve.
+   uint8_t ramp_curve;                       // The curve ramp_table was built for. See ramp_curve_t.
+   uint16_t ramp_table[RAMP_TABLE_SIZE + 1]; // Ramp envelope, power modifier (fraction of UINT16_MAX) at evenly spaced phases.
+   uint16_t ramp_time_ms[2];                 // The on/off ramp times ramp_phase_inc was computed for.
+   uint32_t ramp_phase_inc[2];               // On/off ramp phase increment per microsecond (Q16 phase, scaled by 2^16).
+
+   uint8_t sweep_mask; // Bitmask of parameters that are sweeping (LSB=param 0), only these parameters are stepped.
+   uint8_t stale_mask; // Bitmask of parameters with changed targets (LSB=param 0), step/period are recomputed before the next step.
+
+   parameter_t parameters[TOTAL_PARAMS];
+
+   derived_t derived;
+} generator_t;
+
+// Shared timebase for phase locked channels.
+typedef struct {
+   nco_t nco;              // Group timebase.
+   uint32_t freq_q8;       // The frequency nco was configured for (dHz, Q8).
+   uint32_t event_time_us; // The ideal absolute timestamp of the latest event, members pulse relative to this.
+   uint32_t event_seq;     // Incremented every event.
+} group_t;
+
+typedef struct {
+   uint32_t deadline_us; // The absolute timestamp when the slot next needs processing.
+   uint8_t slot;         // Channel index, or one of SCHED_SLOT_*.
+} sched_entry_t;
+
+// A deferred generator action, linked into a wheel bucket (or the free list).
+typedef struct {
+   uint32_t due_us;      // The absolute timestamp the action should run.
+   uint32_t expiry_tick; // The wheel tick the action runs on.
+   uint8_t type;         // ACTION_ENABLE, ACTION_DISABLE, or ACTION_TOGGLE. See action_type_t.
+   ch_mask_t ch_mask;    // Channel mask the action applies to (LSB=channel 1).
+   uint8_t next;         // Next timer in the bucket (or free list), or TIMER_WHEEL_NONE.
+} deferred_t;
+
+static_assert(TIMER_WHEEL_CAPACITY < TIMER_WHEEL_NONE); // Ensure timer indices fit
+
+// A validated action (enabled, known type, and in range param/target).
+typedef struct {
+   uint8_t type; // See action_type_t.
+   ch_mask_t ch_mask;
+   uint8_t param;  // See param_t.
+   uint8_t target; // See target_t.
+   uint16_t value;
+   uint16_t duration_ms; // ACTION_RAMP_TO duration.
+} action_op_t;
+
+// An action list range flattened into ops, with ACTION_EXECUTE chains inlined.
+typedef struct {
+   bool valid; // True if ops contains the compiled range.
+   uint8_t al_start;
+   uint8_t al_end;
+   uint8_t count;
+   action_op_t ops[ACTION_CACHE_MAX_OPS];
+} action_list_t;
+
+// A validated modulation route for a single destination channel.
+typedef struct {
+   uint8_t source; // See mod_source_t.
+   uint8_t source_index;
+   uint8_t source_param;
+   uint8_t ch_index;
+   uint8_t param;
+   uint8_t target;
+   bool last; // True if this is the last op for the destination, the summed modulation is written after it.
+   uint16_t offset;
+   int16_t depth;
+} mod_op_t;
+
+// A compiled timeline step. Steps with zero duration are removed, and scene entries are flattened into per-channel scene ops.
+typedef struct {
+   uint32_t duration_us;
+   uint32_t fade_us;  // Crossfade into the next step, limited to the duration.
+   ch_mask_t en_mask; // Channels enabled during the step.
+   uint16_t op_start; // Scene ops set when the step starts (op_start to op_end, exclusive).
+   uint16_t op_end;
+} timeline_entry_t;
+
+// A validated scene entry value for a single channel.
+typedef struct {
+   uint8_t ch_index;
+   uint8_t param;
+   uint8_t target;
+   uint16_t value;
+} scene_op_t;
+
+// A parameter target moving linearly to a value. See fade_start().
+typedef struct {
+   bool active;
+   uint8_t ch_index;
+   uint8_t param;  // See param_t.
+   uint8_t target; // See target_t.
+   uint16_t from;
+   uint16_t to;
+   uint32_t start_us;  // The absolute timestamp the fade started.
+   uint32_t phase_inc; // Fraction of the fade completed per microsecond (Q32).
+} fade_t;
+
+// A parameter target that differs between the morph banks.
+typedef struct {
+   uint8_t ch_index;
+   uint8_t param;  // See param_t.
+   uint8_t target; // See target_t.
+   bool step;      // True if the value switches at the midpoint instead of being interpolated (e.g. TARGET_MODE).
+   uint16_t from;  // Bank A value.
+   int32_t delta;  // Bank B value minus bank A value.
+} morph_op_t;
+
+typedef enum {
+   COMPILE_OK = 0,
+   COMPILE_CYCLE,    // ACTION_EXECUTE chain runs an action list that is already running.
+   COMPILE_DEPTH,    // ACTION_EXECUTE chain is nested more than ACTION_CACHE_MAX_DEPTH.
+   COMPILE_OVERFLOW, // More than ACTION_CACHE_MAX_OPS ops.
+} compile_result_t;
+
+static inline void parameter_step(uint8_t ch_index, param_t param, uint32_t now_us, uint32_t* deadline_us);
+static inline void sweep_mask_update(uint8_t ch_index, param_t param);
+static void action_cache_rebuild();
+static void mod_routes_compile();
+static void timeline_compile();
+static void morph_compile();
+static void config_apply();
+static void sched_alarm_cb(uint alarm_num);
+
+static generator_t generators[CHANNEL_COUNT] = {0};
+
+static group_t groups[MAX_GROUPS] = {0};
+
+static uint16_t lfo_table[LFO_TABLE_SIZE + 1]; // Raised sine over one cycle (fraction of UINT16_MAX), shared by every LFO waveform
+static uint32_t lfo_random_state = 0x2545f491; // TARGET_MODE_RANDOM generator state
+
+static nco_t sequencer_nco = {0};
+
+static deferred_t timers[TIMER_WHEEL_CAPACITY];
+static uint8_t timer_buckets[TIMER_WHEEL_SLOTS]; // Head timer index of each bucket
+static uint8_t timer_free;                       // Head timer index of the free list
+static uint32_t timer_tick;                      // The last processed wheel tick
+static uint32_t timer_tick_time_us;              // The absolute timestamp of the last processed wheel tick
+
+static timer_wheel_stats_t timer_stats;
+
+static mod_op_t mod_ops[MAX_MOD_ROUTES * CHANNEL_COUNT]; // Compiled modulation routes, grouped by destination
+static uint8_t mod_op_count = 0;
+static nco_t mod_nco = {.period_us = MOD_UPDATE_PERIOD_US, .restart = true};
+
+static timeline_entry_t timeline_entries[MAX_TIMELINE_STEPS]; // Compiled timeline, empty if the timeline is disabled
+static uint8_t timeline_entry_count = 0;
+static scene_op_t scene_ops[MAX_SCENE_OPS];
+static uint16_t scene_op_count = 0;
+static uint8_t timeline_index = 0;     // The current compiled step
+static uint32_t timeline_step_time_us; // The absolute timestamp the current step started
+static bool timeline_fading = false;   // True if the crossfade into the next step has started
+static bool timeline_restart = false;  // True if the timeline should start again from the first step
+
+static fade_t fades[MAX_FADES];
+static uint8_t fade_count = 0; // Number of active fades
+static nco_t fade_nco = {.period_us = FADE_UPDATE_PERIOD_US, .restart = true};
+
+static morph_op_t morph_ops[CHANNEL_COUNT * TOTAL_PARAMS * TOTAL_TARGETS]; // Compiled morph, empty if morphing is disabled
+static uint16_t morph_op_count = 0;
+
+static action_list_t action_cache[ACTION_CACHE_SIZE];
+static size_t action_cache_next = 0; // Next cache entry to replace on a miss
+
+// Min-heap of slot deadlines, the soonest deadline is at index zero.
+static sched_entry_t sched_heap[SCHED_SLOTS];
+static size_t sched_heap_size = 0;
+
+static uint sched_alarm_num;
+
+static volatile bool sched_due = true;   // True if the soonest deadline has passed (set from alarm IRQ).
+static volatile bool sched_dirty = true; // True if every slot needs to be re-evaluated (e.g. configuration changed).
+static uint32_t sched_marked = 0;        // Bitmask of slots (LSB=slot 0) to re-evaluate on the next pass, see sched_mark().
+
+static pulse_gen_t pulse_gen_banks[2] = {0};
+
+pulse_gen_t* pulse_gen = &pulse_gen_banks[0];
+static pulse_gen_t* pulse_gen_shadow = &pulse_gen_banks[1]; // Staged configuration, see pulse_gen_begin()
+
+static bool config_staging = false;        // True while writes are staged in pulse_gen_shadow.
+static bool config_commit_pending = false; // True if pulse_gen_shadow should become live at the start of the next pass.
+
+// Runtime state held in the configuration (also written by sweeps, fades, actions, etc.) that was written while staging. See config_merge_runtime().
+static struct {
+   ch_mask_t en_mask;                               // Enable bits written (changed by a write), LSB=channel 1.
+   bool sequencer_index;                            // True if the sequencer index was written (e.g. reset).
+   uint8_t parameters[CHANNEL_COUNT][TOTAL_PARAMS]; // Bitmask of targets written (LSB=target 0).
+} config_written;
+
+void pulse_gen_init() {
+   LOG_DEBUG("Init pulse generator...\n");
+
+   // Set default parameter values
+   for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+      parameter_set(ch_index, PARAM_POWER, TARGET_MAX, UINT16_MAX);   // max. 100% (auto cycle limit)
+      parameter_set(ch_index, PARAM_POWER, TARGET_VALUE, UINT16_MAX); // 100%
+
+      parameter_set(ch_index, PARAM_FREQUENCY, TARGET_MAX, 5000);   // max. 500 Hz (auto cycle limit)
+      parameter_set(ch_index, PARAM_FREQUENCY, TARGET_VALUE, 1800); // 180 Hz
+
+      parameter_set(ch_index, PARAM_PULSE_WIDTH, TARGET_MAX, 500);   // max. 500 us (auto cycle limit)
+      parameter_set(ch_index, PARAM_PULSE_WIDTH, TARGET_VALUE, 150); // 150 us
+
+      parameter_set(ch_index, PARAM_ON_TIME, TARGET_MAX, 10000);      // max. 10 seconds (auto cycle limit)
+      parameter_set(ch_index, PARAM_ON_RAMP_TIME, TARGET_MAX, 5000);  // max. 5 seconds (auto cycle limit)
+      parameter_set(ch_index, PARAM_OFF_TIME, TARGET_MAX, 10000);     // max. 10 seconds (auto cycle limit)
+      parameter_set(ch_index, PARAM_OFF_RAMP_TIME, TARGET_MAX, 5000); // max. 5 seconds (auto cycle limit)
+
+      for (size_t i = 0; i <= POWER_LUT_SIZE; i++) // Linear width power table
+         pulse_gen->channels[ch_index].power_lut[i] = (i * UINT16_MAX) / POWER_LUT_SIZE;
+   }
+
+   // Build the LFO wavetable, only done once so float math is fine here
+   for (size_t i = 0; i <= LFO_TABLE_SIZE; i++)
+      lfo_table[i] = lroundf((1.0f - cosf(2.0f * (float)M_PI * i / LFO_TABLE_SIZE)) * 0.5f * UINT16_MAX);
+
+   // Claim a hardware alarm for waking the generator when the next deadline is reached
+   sched_alarm_num = hardware_alarm_claim_unused(true);
+   hardware_alarm_set_callback(sched_alarm_num, sched_alarm_cb);
+
+   // Link every timer into the free list
+   for (size_t i = 0; i < TIMER_WHEEL_SLOTS; i++)
+      timer_buckets[i] = TIMER_WHEEL_NONE;
+   for (size_t i = 0; i < TIMER_WHEEL_CAPACITY; i++)
+      timers[i].next = (i + 1 < TIMER_WHEEL_CAPACITY) ? i + 1 : TIMER_WHEEL_NONE;
+   timer_free = 0;
+   timer_stats.capacity = TIMER_WHEEL_CAPACITY;
+
+   pulse_gen_reschedule();
+}
+
+// Recompute the derived values of the channel in the mask, see DERIVED_PARAM_BITS.
+static inline void derived_refresh(uint8_t ch_index, uint8_t mask) {
+   derived_update(&generators[ch_index].derived, mask, pulse_gen->channels[ch_index].parameters, STATE_SEQUENCE, pulse_gen->channels[ch_index].frequency_frac,
+                  MAX_FREQ_Q8);
+}
+
+// Returns the derived values of the channel. They are kept current by parameter_set(), except frequency_frac which is written directly.
+static inline const derived_t* derived_get(uint8_t ch_index) {
+   if (generators[ch_index].derived.frequency_frac != pulse_gen->channels[ch_index].frequency_frac)
+      derived_refresh(ch_index, 1 << DERIVED_FREQ);
+   return &generators[ch_index].derived;
+}
+
+// Build the channel ramp envelope table for the given curve. Only done when the curve changes, so float math is fine here.
+static void ramp_table_build(generator_t* gen, uint8_t curve) {
+   for (size_t i = 0; i <= RAMP_TABLE_SIZE; i++) {
+      const float x = (float)i / RAMP_TABLE_SIZE;
+
+      float y;
+      switch (curve) {
+         case RAMP_CURVE_EXPONENTIAL:
+            y = (expf(RAMP_CURVE_EXP_K * x) - 1.0f) / (expf(RAMP_CURVE_EXP_K) - 1.0f);
+            break;
+         case RAMP_CURVE_S_CURVE:
+            y = x * x * (3.0f - 2.0f * x);
+            break;
+         case RAMP_CURVE_LOGARITHMIC:
+            y = logf(1.0f + RAMP_CURVE_LOG_K * x) / logf(1.0f + RAMP_CURVE_LOG_K);
+            break;
+         case RAMP_CURVE_LINEAR:
+         default:
+            y = x;
+            break;
+      }
+
+      gen->ramp_table[i] = fclamp(y, 0.0f, 1.0f) * UINT16_MAX;
+   }
+
+   gen->ramp_curve = curve;
+   gen->ramp_built = true;
+}
+
+// Returns the ramp power modifier (fraction of UINT16_MAX) for the time elapsed since the ramp started.
+// The table is rebuilt if the curve changed, and the phase increment is recomputed if the ramp time changed.
+static inline uint16_t ramp_modifier(uint8_t ch_index, bool off_ramp, uint16_t ramp_time_ms, uint32_t elapsed_us) {
+   generator_t* const gen = &generators[ch_index];
+
+   const uint8_t curve = pulse_gen->channels[ch_index].ramp_curve;
+   if (!gen->ramp_built || gen->ramp_curve != curve)
+      ramp_table_build(gen, curve);
+
+   if (gen->ramp_time_ms[off_ramp] != ramp_time_ms || gen->ramp_phase_inc[off_ramp] == 0) {
+      const uint32_t ramp_time_us = ramp_time_ms * 1000u;
+
+      gen->ramp_time_ms[off_ramp] = ramp_time_ms;
+      gen->ramp_phase_inc[off_ramp] = phase_inc_us(ramp_time_us);
+   }
+
+   return ramp_envelope(gen->ramp_table, gen->ramp_phase_inc[off_ramp], off_ramp, elapsed_us);
+}
+
+static inline bool sched_before(const sched_entry_t* a, const sched_entry_t* b) {
+   return (int32_t)(a->deadline_us - b->deadline_us) < 0;
+}
+
+// Sift the entry up until its parent is sooner.
+static void sched_sift_up(size_t i) {
+   while (i > 0) {
+      const size_t parent = (i - 1) / 2;
+      if (!sched_before(&sched_heap[i], &sched_heap[parent]))
+         break;
+
+      const sched_entry_t tmp = sched_heap[parent];
+      sched_heap[parent] = sched_heap[i];
+      sched_heap[i] = tmp;
+      i = parent;
+   }
+}
+
+static void sched_push(uint8_t slot, uint32_t deadline_us) {
+   const size_t i = sched_heap_size++;
+   sched_heap[i] = (sched_entry_t){.deadline_us = deadline_us, .slot = slot};
+
+   sched_sift_up(i);
+}
+
+static sched_entry_t sched_pop() {
+   const sched_entry_t top = sched_heap[0];
+   sched_heap[0] = sched_heap[--sched_heap_size];
+
+   // Sift down until both children are later
+   size_t i = 0;
+   while (true) {
+      const size_t left = (i * 2) + 1;
+      const size_t right = left + 1;
+
+      size_t smallest = i;
+      if (left < sched_heap_size && sched_before(&sched_heap[left], &sched_heap[smallest]))
+         smallest = left;
+      if (right < sched_heap_size && sched_before(&sched_heap[right], &sched_heap[smallest]))
+         smallest = right;
+
+      if (smallest == i)
+         break;
+
+      const sched_entry_t tmp = sched_heap[smallest];
+      sched_heap[smallest] = sched_heap[i];
+      sched_heap[i] = tmp;
+      i = smallest;
+   }
+   return top;
+}
+
+// Hardware alarm callback, flags the generator as due. Runs in IRQ context so only touches volatile flags.
+static void sched_alarm_cb(uint alarm_num) {
+   (void)alarm_num;
+   sched_due = true;
+}
+
+// Arm the hardware alarm for the given deadline. Flags the generator as due if the deadline has already passed.
+static inline void sched_arm(uint32_t deadline_us) {
+   const int32_t delay_us = deadline_us - time_us_32();
+
+   // hardware_alarm_set_target() returns true if the target time is missed
+   if (delay_us <= 0 || hardware_alarm_set_target(sched_alarm_num, delayed_by_us(get_absolute_time(), delay_us)))
+      sched_due = true;
+}
+
+void pulse_gen_reschedule() {
+   sched_dirty = true;
+   sched_due = true;
+}
+
+// Re-evaluate only the slot on the next pass, e.g. a channel whose parameters were written by a fade or modulation route.
+static inline void sched_mark(uint8_t slot) {
+   sched_marked |= (1u << slot);
+   sched_due = true;
+}
+
+// Bring the deadlines of marked slots forward to now. Slots are marked for the next pass, so a slot is still processed at most once per pass.
+static void sched_marked_apply(uint32_t now_us) {
+   for (size_t i = 0; sched_marked && i < sched_heap_size; i++) {
+      const uint32_t bit = 1u << sched_heap[i].slot;
+      if (!(sched_marked & bit))
+         continue;
+      sched_marked &= ~bit;
+
+      if (!deadline_reached(sched_heap[i].deadline_us, now_us)) {
+         sched_heap[i].deadline_us = now_us;
+         sched_sift_up(i); // Only moves entries before i, which have already been checked
+      }
+   }
+}
+
+void pulse_gen_begin() {
+   if (config_commit_pending) // Stage on top of the committed configuration
+      config_apply();
+
+   memcpy(pulse_gen_shadow, pulse_gen, sizeof(pulse_gen_t));
+   memset(&config_written, 0, sizeof(config_written));
+   config_staging = true;
+}
+
+void pulse_gen_commit() {
+   if (!config_staging)
+      return;
+
+   config_staging = false;
+   config_commit_pending = true;
+   pulse_gen_reschedule();
+}
+
+void pulse_gen_abort() {
+   config_staging = false;
+}
+
+bool pulse_gen_staging() {
+   return config_staging;
+}
+
+pulse_gen_t* pulse_gen_config() {
+   return config_staging ? pulse_gen_shadow : pulse_gen;
+}
+
+// Carry runtime changes made to the live configuration while staging (e.g. sweep values, enable mask, sequencer index) over to the staged
+// configuration. Fields written while staging are kept, so a commit only overrides what was written. Parameters and the sequencer index count
+// as written even if written with the value they had, enable bits only if a write changed them.
+static void config_merge_runtime(pulse_gen_t* staged, const pulse_gen_t* live) {
+   staged->en_mask = (live->en_mask & ~config_written.en_mask) | (staged->en_mask & config_written.en_mask);
+
+   if (!config_written.sequencer_index)
+      staged->sequencer.index = live->sequencer.index;
+
+   for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+      for (param_t param = 0; param < TOTAL_PARAMS; param++) {
+         const uint8_t written = config_written.parameters[ch_index][param];
+
+         for (target_t target = 0; target < TOTAL_TARGETS; target++) {
+            if (!(written & (1 << target)))
+               staged->channels[ch_index].parameters[param][target] = live->channels[ch_index].parameters[param][target];
+         }
+      }
+   }
+}
+
+// Make the staged configuration live. Generator sweep state and compiled action lists are derived from the configuration, so they are refreshed.
+static void config_apply() {
+   config_commit_pending = false;
+
+   config_merge_runtime(pulse_gen_shadow, pulse_gen);
+
+   pulse_gen_t* const previous = pulse_gen;
+   pulse_gen = pulse_gen_shadow;
+   pulse_gen_shadow = previous;
+
+   // Only parameters with changed targets need their step/period recomputed, so running sweeps are left alone
+   for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+      generator_t* const gen = &generators[ch_index];
+
+      for (param_t param = 0; param < TOTAL_PARAMS; param++) {
+         const uint16_t* const targets = pulse_gen->channels[ch_index].parameters[param];
+         if (memcmp(previous->channels[ch_index].parameters[param], targets, sizeof(previous->channels[ch_index].parameters[param])) == 0)
+            continue;
+
+         sweep_mask_update(ch_index, param);
+         gen->stale_mask |= (1 << param);
+
+         if (DERIVED_PARAM_BITS[param])
+            derived_refresh(ch_index, DERIVED_PARAM_BITS[param]);
+      }
+   }
+
+   action_cache_rebuild();
+   mod_routes_compile();
+
+   if (memcmp(&previous->timeline, &pulse_gen->timeline, sizeof(pulse_gen->timeline)) != 0) // Only restart the timeline if it changed
+      timeline_compile();
+
+   if (memcmp(&previous->morph, &pulse_gen->morph, sizeof(pulse_gen->morph)) != 0)
+      morph_compile();
+   pulse_gen_reschedule();
+}
+
+static inline ch_mask_t sequencer_mask() {
+   if (timeline_entry_count) // Timeline replaces the sequencer while enabled
+      return timeline_entries[timeline_index].en_mask;
+
+   if (pulse_gen->sequencer.period_us == 0 || pulse_gen->sequencer.count == 0)
+      return CHANNEL_MASK_ALL; // If sequencer is disabled, mask all enabled
+
+   return pulse_gen->sequencer.masks[pulse_gen->sequencer.index];
+}
+
+// Schedule a deferred enable/disable/toggle of the channel mask, run from the generator loop (not IRQ context).
+static void timer_wheel_add(action_type_t type, ch_mask_t ch_mask, uint16_t delay_ms) {
+   const uint8_t index = timer_free;
+   if (index == TIMER_WHEEL_NONE) {
+      timer_stats.overflows++;
+      LOG_WARN("Deferred action dropped, timer wheel full! type=%u ch_mask=%u delay_ms=%u", type, ch_mask, delay_ms);
+      return;
+   }
+   timer_free = timers[index].next;
+
+   const uint32_t now_us = time_us_32();
+   if (timer_stats.occupancy == 0) // Wheel was idle, so restart ticking from now instead of catching up
+      timer_tick_time_us = now_us;
+
+   // Round up so the action never runs early
+   const uint32_t delay_us = delay_ms * 1000u + (now_us - timer_tick_time_us);
+   const uint32_t ticks = (delay_us + TIMER_WHEEL_TICK_US - 1) / TIMER_WHEEL_TICK_US;
+
+   deferred_t* const timer = &timers[index];
+   timer->due_us = now_us + delay_ms * 1000u;
+   timer->expiry_tick = timer_tick + (ticks ? ticks : 1);
+   timer->type = type;
+   timer->ch_mask = ch_mask;
+
+   const size_t bucket = timer->expiry_tick % TIMER_WHEEL_SLOTS;
+   timer->next = timer_buckets[bucket];
+   timer_buckets[bucket] = index;
+
+   if (++timer_stats.occupancy > timer_stats.peak_occupancy)
+      timer_stats.peak_occupancy = timer_stats.occupancy;
+}
+
+// Run the expired timers in the bucket for the current tick. Timers that expire on a later lap of the wheel stay in the bucket.
+static void timer_wheel_expire_bucket(uint32_t now_us) {
+   uint8_t* link = &timer_buckets[timer_tick % TIMER_WHEEL_SLOTS];
+
+   while (*link != TIMER_WHEEL_NONE) {
+      const uint8_t index = *link;
+      deferred_t* const timer = &timers[index];
+
+      if ((int32_t)(timer->expiry_tick - timer_tick) > 0) {
+         link = &timer->next;
+         continue;
+      }
+
+      switch (timer->type) {
+         case ACTION_ENABLE:
+            pulse_gen->en_mask |= timer->ch_mask;
+            break;
+         case ACTION_DISABLE:
+            pulse_gen->en_mask &= ~timer->ch_mask;
+            break;
+         case ACTION_TOGGLE:
+            pulse_gen->en_mask ^= timer->ch_mask;
+            break;
+         default:
+            break;
+      }
+
+      const uint32_t late_us = now_us - timer->due_us;
+      if ((int32_t)late_us > 0 && late_us > timer_stats.max_late_us)
+         timer_stats.max_late_us = late_us;
+      timer_stats.expired++;
+      timer_stats.occupancy--;
+
+      // Unlink from bucket and return to free list
+      *link = timer->next;
+      timer->next = timer_free;
+      timer_free = index;
+   }
+}
+
+// Advance the timer wheel to the current time, running expired deferred actions. Returns the next deadline.
+static uint32_t timer_wheel_process(uint32_t now_us) {
+   if (timer_stats.occupancy == 0)
+      return now_us + SCHED_IDLE_PERIOD_US;
+
+   uint32_t ticks = (now_us - timer_tick_time_us) / TIMER_WHEEL_TICK_US;
+   if (ticks > TIMER_WHEEL_SLOTS) { // Far behind, skip ahead since visiting each bucket once expires everything that is due
+      timer_tick += ticks - TIMER_WHEEL_SLOTS;
+      timer_tick_time_us += (ticks - TIMER_WHEEL_SLOTS) * TIMER_WHEEL_TICK_US;
+      ticks = TIMER_WHEEL_SLOTS;
+   }
+
+   const ch_mask_t en_mask = pulse_gen->en_mask;
+   while (ticks--) {
+      timer_tick++;
+      timer_tick_time_us += TIMER_WHEEL_TICK_US;
+      timer_wheel_expire_bucket(now_us);
+   }
+
+   if (pulse_gen->en_mask != en_mask)
+      pulse_gen_reschedule(); // Channel enable state changed
+
+   if (timer_stats.occupancy == 0)
+      return now_us + SCHED_IDLE_PERIOD_US;
+   return timer_tick_time_us + TIMER_WHEEL_TICK_US;
+}
+
+const timer_wheel_stats_t* timer_wheel_stats() {
+   return &timer_stats;
+}
+
+void timer_wheel_stats_reset() {
+   timer_stats.peak_occupancy = timer_stats.occupancy;
+   timer_stats.overflows = 0;
+   timer_stats.expired = 0;
+   timer_stats.max_late_us = 0;
+}
+
+static bool mod_route_valid(const mod_route_t* route) {
+   switch (route->source) {
+      case MOD_SOURCE_PARAMETER:
+         if (route->source_index >= CHANNEL_COUNT || route->source_param >= TOTAL_PARAMS)
+            return false;
+         break;
+      case MOD_SOURCE_AUDIO:
+         if (route->source_index >= TOTAL_ANALOG_CHANNELS)
+            return false;
+         break;
+      case MOD_SOURCE_TRIGGER:
+         if (route->source_index >= TOTAL_TRIGGERS - 1)
+            return false;
+         break;
+      case MOD_SOURCE_KNOB:
+         if (route->source_index >= CHANNEL_COUNT)
+            return false;
+         break;
+      case MOD_SOURCE_NONE: // Disabled routes are valid, they are just not compiled
+         return true;
+      default:
+         return false;
+   }
+   return route->param < TOTAL_PARAMS && route->target < TOTAL_TARGETS;
+}
+
+// Flatten the live routes into one op per destination channel, grouped by destination so contributions can be summed in one pass.
+static void mod_routes_compile() {
+   mod_op_count = 0;
+
+   for (size_t r_index = 0; r_index < MAX_MOD_ROUTES; r_index++) {
+      const mod_route_t* const route = &pulse_gen->mod_routes[r_index];
+      if (route->source == MOD_SOURCE_NONE || !mod_route_valid(route))
+         continue;
+
+      for (uint8_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+         if (!(route->ch_mask & (1 << ch_index)))
+            continue;
+
+         const mod_op_t op = {
+             .source = route->source,
+             .source_index = route->source_index,
+             .source_param = route->source_param,
+             .ch_index = ch_index,
+             .param = route->param,
+             .target = route->target,
+             .offset = route->offset,
+             .depth = route->depth,
+         };
+
+         // Insert after the last op with the same destination (or at the end), keeping route order within a destination
+         size_t pos = mod_op_count;
+         for (size_t i = 0; i < mod_op_count; i++) {
+            if (mod_ops[i].ch_index == ch_index && mod_ops[i].param == op.param && mod_ops[i].target == op.target)
+               pos = i + 1;
+         }
+
+         for (size_t i = mod_op_count; i > pos; i--)
+            mod_ops[i] = mod_ops[i - 1];
+         mod_ops[pos] = op;
+         mod_op_count++;
+      }
+   }
+
+   for (size_t i = 0; i < mod_op_count; i++) {
+      const mod_op_t* const next = (i + 1 < mod_op_count) ? &mod_ops[i + 1] : NULL;
+      mod_ops[i].last = !next || next->ch_index != mod_ops[i].ch_index || next->param != mod_ops[i].param || next->target != mod_ops[i].target;
+   }
+
+   mod_nco.restart = true;
+}
+
+// Returns the source level of the op, as a fraction of UINT16_MAX. Audio amplitudes are fetched at most once per evaluation.
+static inline uint16_t mod_source_level(const mod_op_t* op, uint16_t amplitudes[], uint8_t* fetched_mask) {
+   switch (op->source) {
+      case MOD_SOURCE_PARAMETER: {
+         const uint16_t value = parameter_get(op->source_index, op->source_param, TARGET_VALUE);
+         const uint16_t min = parameter_get(op->source_index, op->source_param, TARGET_MIN);
+         const uint16_t max = parameter_get(op->source_index, op->source_param, TARGET_MAX);
+         if (value <= min) // Also covers an empty range (max <= min), so the level stays a fraction
+            return 0;
+         if (value >= max)
+            return UINT16_MAX;
+         return ((uint32_t)(value - min) * UINT16_MAX) / (max - min);
+      }
+      case MOD_SOURCE_AUDIO:
+         if (!(*fetched_mask & (1 << op->source_index))) {
+            *fetched_mask |= (1 << op->source_index);
+            amplitudes[op->source_index] = analog_amplitude(op->source_index);
+         }
+         return amplitudes[op->source_index];
+      case MOD_SOURCE_TRIGGER:
+         return (trig_input_states & (1 << op->source_index)) ? UINT16_MAX : 0;
+      case MOD_SOURCE_KNOB:
+         return channels[op->source_index].max_power;
+      default:
+         return 0;
+   }
+}
+
+// Evaluate the compiled modulation routes, writing each destination once.
+static uint32_t mod_process(uint32_t now_us) {
+   if (mod_op_count == 0)
+      return now_us + SCHED_IDLE_PERIOD_US;
+
+   if (!nco_due(&mod_nco, now_us))
+      return mod_nco.next_time_us;
+   nco_advance(&mod_nco);
+
+   uint16_t amplitudes[TOTAL_ANALOG_CHANNELS];
+   uint8_t fetched_mask = 0;
+
+   int32_t sum = 0;
+
+   for (size_t i = 0; i < mod_op_count; i++) {
+      const mod_op_t* const op = &mod_ops[i];
+
+      const uint16_t level = mod_source_level(op, amplitudes, &fetched_mask);
+      sum += op->offset + (((int32_t)level * op->depth) >> 15);
+
+      if (!op->last)
+         continue;
+
+      uint16_t value = MIN(MAX(sum, 0), UINT16_MAX);
+      sum = 0;
+
+      if (op->target == TARGET_VALUE) { // Scale to the destination parameter range
+         const uint16_t min = parameter_get(op->ch_index, op->param, TARGET_MIN);
+         const uint16_t max = parameter_get(op->ch_index, op->param, TARGET_MAX);
+         if (max > min)
+            value = min + ((uint32_t)(max - min) * value) / UINT16_MAX;
+      }
+
+      if (parameter_get(op->ch_index, op->param, op->target) != value) {
+         parameter_set(op->ch_index, op->param, op->target, value);
+         sched_mark(op->ch_index); // Destination channel needs re-evaluating
+      }
+   }
+
+   return mod_nco.next_time_us;
+}
+
+// Step the sequencer if required. Returns the next sequencer deadline.
+static uint32_t sequencer_process(uint32_t now_us) {
+   if (pulse_gen->sequencer.period_us == 0 || pulse_gen->sequencer.count == 0)
+      return now_us + SCHED_IDLE_PERIOD_US;
+
+   nco_set_period(&sequencer_nco, (uint64_t)pulse_gen->sequencer.period_us << 32);
+
+   if (nco_due(&sequencer_nco, now_us)) {
+      nco_advance(&sequencer_nco);
+
+      if (++pulse_gen->sequencer.index >= pulse_gen->sequencer.count)
+         pulse_gen->sequencer.index = 0; // Increment or reset after count
+
+      pulse_gen_reschedule(); // Channel enable state might have changed
+   }
+
+   if (pulse_gen->sequencer.index >= MAX_SEQUENCES)
+      pulse_gen->sequencer.index = MAX_SEQUENCES - 1;
+
+   return sequencer_nco.next_time_us;
+}
+
+// Fade a parameter target from its current value to the value over the duration, replacing any running fade of the same target.
+// A zero duration sets the value immediately, as does running out of fade slots.
+static void fade_start(uint8_t ch_index, param_t param, target_t target, uint16_t value, uint32_t duration_us, uint32_t now_us) {
+   fade_t* slot = NULL;
+   for (size_t i = 0; i < MAX_FADES; i++) {
+      fade_t* const fade = &fades[i];
+      if (fade->active && fade->ch_index == ch_index && fade->param == param && fade->target == target) {
+         slot = fade;
+         break;
+      }
+      if (!fade->active && !slot)
+         slot = fade;
+   }
+
+   if (duration_us == 0 || !slot) {
+      if (!slot)
+         LOG_WARN("Fade dropped, no free slots! ch=%u param=%u target=%u", ch_index, param, target);
+
+      if (slot && slot->active) { // Cancel the running fade, so it doesn't overwrite the value
+         slot->active = false;
+         fade_count--;
+      }
+
+      parameter_set(ch_index, param, target, value);
+      return;
+   }
+
+   if (!slot->active) {
+      if (fade_count++ == 0)
+         fade_nco.restart = true; // Fades were idle, so start evaluating from now
+   }
+
+   *slot = (fade_t){
+       .active = true,
+       .ch_index = ch_index,
+       .param = param,
+       .target = target,
+       .from = parameter_get(ch_index, param, target),
+       .to = value,
+       .start_us = now_us,
+       .phase_inc = phase_inc_us(duration_us),
+   };
+
+   pulse_gen_reschedule();
+}
+
+// Step every running fade. Returns the next fade deadline.
+static uint32_t fade_process(uint32_t now_us) {
+   if (fade_count == 0)
+      return now_us + SCHED_IDLE_PERIOD_US;
+
+   if (!nco_due(&fade_nco, now_us))
+      return fade_nco.next_time_us;
+   nco_advance(&fade_nco);
+
+   for (size_t i = 0; i < MAX_FADES; i++) {
+      fade_t* const fade = &fades[i];
+      if (!fade->active)
+         continue;
+
+      // Fraction of the fade completed (Q16)
+      const uint32_t phase = phase_elapsed(now_us - fade->start_us, fade->phase_inc);
+
+      uint16_t value = fade->to;
+      if (phase < (1u << 16)) {
+         value = q16_lerp(fade->from, fade->to, phase);
+      } else {
+         fade->active = false;
+         fade_count--;
+      }
+
+      if (parameter_get(fade->ch_index, fade->param, fade->target) != value) {
+         parameter_set(fade->ch_index, fade->param, fade->target, value);
+         sched_mark(fade->ch_index); // Destination channel needs re-evaluating
+      }
+   }
+
+   return fade_nco.next_time_us;
+}
+
+// Stop any running fade of the parameter target, leaving its current value.
+static void fade_cancel(uint8_t ch_index, param_t param, target_t target) {
+   if (fade_count == 0)
+      return;
+
+   for (size_t i = 0; i < MAX_FADES; i++) {
+      fade_t* const fade = &fades[i];
+      if (fade->active && fade->ch_index == ch_index && fade->param == param && fade->target == target) {
+         fade->active = false;
+         fade_count--;
+         return;
+      }
+   }
+}
+
+void parameter_ramp(ch_mask_t ch_mask, param_t param, target_t target, uint16_t value, uint16_t duration_ms) {
+   if (param >= TOTAL_PARAMS || target >= TOTAL_TARGETS)
+      return;
+
+   const uint32_t now_us = time_us_32();
+   for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+      if (~ch_mask & (1 << ch_index))
+         continue;
+
+      uint16_t val = value;
+      if (target == TARGET_VALUE) // Limit target value between TARGET_MIN and TARGET_MAX
+         val = MIN(MAX(val, parameter_get(ch_index, param, TARGET_MIN)), parameter_get(ch_index, param, TARGET_MAX));
+
+      fade_start(ch_index, param, target, val, duration_ms * 1000u, now_us);
+   }
+}
+
+// Flatten the timeline steps into timeline_entries, and their scene entries into per-channel scene ops. Restarts the timeline.
+static void timeline_compile() {
+   timeline_entry_count = 0;
+   scene_op_count = 0;
+
+   const uint8_t count = MIN(pulse_gen->timeline.count, MAX_TIMELINE_STEPS);
+   for (size_t s_index = 0; s_index < count; s_index++) {
+      const timeline_step_t* const step = &pulse_gen->timeline.steps[s_index];
+      if (step->duration_ms == 0)
+         continue;
+
+      timeline_entry_t* const entry = &timeline_entries[timeline_entry_count++];
+      entry->duration_us = step->duration_ms * 1000u;
+      entry->fade_us = MIN(step->fade_ms, step->duration_ms) * 1000u;
+      entry->en_mask = step->en_mask;
+      entry->op_start = scene_op_count;
+
+      const size_t scene_end = MIN(step->scene_start + step->scene_count, MAX_SCENE_ENTRIES);
+      for (size_t e_index = step->scene_start; e_index < scene_end; e_index++) {
+         const scene_entry_t* const scene = &pulse_gen->timeline.scenes[e_index];
+         if (scene->param >= TOTAL_PARAMS || scene->target >= TOTAL_TARGETS)
+            continue;
+
+         for (uint8_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+            if (!(scene->ch_mask & (1u << ch_index)))
+               continue;
+
+            if (scene_op_count >= MAX_SCENE_OPS) {
+               LOG_WARN("Timeline scene values dropped, too many values! step=%u", s_index);
+               break;
+            }
+
+            scene_ops[scene_op_count++] = (scene_op_t){.ch_index = ch_index, .param = scene->param, .target = scene->target, .value = scene->value};
+         }
+      }
+
+      entry->op_end = scene_op_count;
+   }
+
+   timeline_index = 0;
+   timeline_restart = true;
+   pulse_gen_reschedule();
+}
+
+// Set (or fade to) the scene values of the compiled step.
+static inline void timeline_scene_set(const timeline_entry_t* entry, uint32_t fade_us, uint32_t now_us) {
+   for (size_t i = entry->op_start; i < entry->op_end; i++) {
+      const scene_op_t* const op = &scene_ops[i];
+      fade_start(op->ch_index, op->param, op->target, op->value, fade_us, now_us);
+   }
+}
+
+// Advance the timeline if required. Returns the next timeline deadline.
+static uint32_t timeline_process(uint32_t now_us) {
+   if (timeline_entry_count == 0)
+      return now_us + SCHED_IDLE_PERIOD_US;
+
+   if (timeline_restart) {
+      timeline_restart = false;
+      timeline_index = 0;
+      timeline_step_time_us = now_us;
+      timeline_fading = false;
+
+      timeline_scene_set(&timeline_entries[0], 0, now_us);
+      pulse_gen_reschedule(); // Channel enable state might have changed
+   }
+
+   for (;;) {
+      const timeline_entry_t* const entry = &timeline_entries[timeline_index];
+      const uint8_t next_index = (timeline_index + 1 < timeline_entry_count) ? timeline_index + 1 : 0;
+      const uint32_t end_us = timeline_step_time_us + entry->duration_us;
+
+      // Crossfade into the next step scene, so it is reached as the next step starts
+      if (!timeline_fading && entry->fade_us) {
+         const uint32_t fade_us = end_us - now_us;
+         if (!deadline_reached(end_us - entry->fade_us, now_us))
+            return end_us - entry->fade_us;
+
+         timeline_fading = true;
+         timeline_scene_set(&timeline_entries[next_index], (int32_t)fade_us > 0 ? fade_us : 0, now_us);
+      }
+
+      if (!deadline_reached(end_us, now_us))
+         return end_us;
+
+      // Next step starts when this one ideally ended, restart from now if more than a step behind
+      timeline_index = next_index;
+      timeline_step_time_us = end_us;
+      if ((now_us - end_us) > timeline_entries[next_index].duration_us)
+         timeline_step_time_us = now_us;
+
+      if (!timeline_fading)
+         timeline_scene_set(&timeline_entries[next_index], 0, now_us);
+      timeline_fading = false;
+
+      pulse_gen_reschedule(); // Channel enable state might have changed
+   }
+}
+
+// Set a channel parameter target, skipping unchanged values so sweep state isn't disturbed.
+static inline void morph_parameter_set(uint8_t ch_index, param_t param, target_t target, uint16_t value) {
+   if (parameter_get(ch_index, param, target) != value)
+      parameter_set(ch_index, param, target, value);
+}
+
+// Set every differing parameter target to its value at the morph position. One multiply-add per value.
+static void morph_apply() {
+   const uint16_t position = pulse_gen->morph.position;
+   const int32_t position_q15 = ((uint32_t)position + 1) >> 1; // Q15 keeps the product in 32 bits, and makes UINT16_MAX exactly bank B
+
+   for (size_t i = 0; i < morph_op_count; i++) {
+      const morph_op_t* const op = &morph_ops[i];
+
+      uint16_t value;
+      if (op->step) {
+         value = position < (1u << 15) ? op->from : op->from + op->delta;
+      } else {
+         value = op->from + ((op->delta * position_q15) >> 15);
+      }
+
+      morph_parameter_set(op->ch_index, op->param, op->target, value);
+   }
+
+   pulse_gen_reschedule();
+}
+
+// Compile the morph banks into ops for the targets that differ, and set the targets that don't. Applies the current position.
+// Targets that haven't been captured into both banks are left alone, so enabling with a partly filled bank doesn't zero the rest.
+static void morph_compile() {
+   morph_op_count = 0;
+   if (!pulse_gen->morph.enabled)
+      return;
+
+   for (uint8_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+      for (param_t param = 0; param < TOTAL_PARAMS; param++) {
+         const uint8_t captured = pulse_gen->morph.captured[0][ch_index][param] & pulse_gen->morph.captured[1][ch_index][param];
+
+         for (target_t target = 0; target < TOTAL_TARGETS; target++) {
+            if (~captured & (1 << target))
+               continue;
+
+            const uint16_t a = pulse_gen->morph.banks[0][ch_index][param][target];
+            const uint16_t b = pulse_gen->morph.banks[1][ch_index][param][target];
+
+            if (a == b) { // Constant, so only set once
+               morph_parameter_set(ch_index, param, target, a);
+               continue;
+            }
+
+            morph_ops[morph_op_count++] = (morph_op_t){
+                .ch_index = ch_index,
+                .param = param,
+                .target = target,
+                .step = target == TARGET_MODE || target == TARGET_ACTION_RANGE,
+                .from = a,
+                .delta = (int32_t)b - a,
+            };
+         }
+      }
+   }
+
+   morph_apply();
+}
+
+// Shape a pulse (or burst of pulses) from the channel waveform. Alternating polarity is applied by generator_pulse().
+static inline void pulse_shape(uint8_t ch_index, uint16_t pulse_width, pulse_t* pulse) {
+   const uint8_t flags = pulse_gen->channels[ch_index].waveform.flags;
+   const uint16_t neg_width_us = pulse_gen->channels[ch_index].waveform.neg_width_us;
+
+   *pulse = (pulse_t){
+       .pos_us = pulse_width,
+       .neg_us = (flags & WAVEFORM_FLAG_MONOPHASIC) ? 0 : (neg_width_us ? neg_width_us : pulse_width),
+       .gap_us = pulse_gen->channels[ch_index].waveform.gap_us,
+       .count = pulse_gen->channels[ch_index].waveform.burst_count,
+       .period_us = pulse_gen->channels[ch_index].waveform.burst_period_us,
+       .flags = 0,
+   };
+
+   if (flags & WAVEFORM_FLAG_ALTERNATE)
+      pulse->flags |= PULSE_FLAG_ALTERNATE;
+
+   if (flags & WAVEFORM_FLAG_INVERT)
+      pulse->flags |= PULSE_FLAG_NEGATIVE;
+}
+
+static inline bool pulse_shape_equal(const pulse_t* a, const pulse_t* b) {
+   return a->pos_us == b->pos_us && a->neg_us == b->neg_us && a->gap_us == b->gap_us && a->count == b->count && a->period_us == b->period_us && a->flags == b->flags;
+}
+
+// True if the polarity of the next pulse flips after each pulse of the given shape.
+static inline bool pulse_shape_alternates(const pulse_t* pulse) {
+   // An odd number of pulses in an alternating burst leaves the polarity flipped for the next burst
+   return (pulse->flags & PULSE_FLAG_ALTERNATE) && (MAX(pulse->count, 1) & 1);
+}
+
+// Queue a pulse (or burst of pulses) shaped by the channel waveform. Returns false if the output queue is full.
+static bool generator_pulse(generator_t* gen, uint8_t ch_index, uint16_t pulse_width, uint32_t abs_time_us) {
+   pulse_t pulse;
+   pulse_shape(ch_index, pulse_width, &pulse);
+   pulse.abs_time_us = abs_time_us;
 
-   uint32_t last_update_time_us; // The absolute timestamp since the last parameter step update.
-   uint32_t update_period_us;    // Parameter step update period.
-} parameter_t;
+   if (gen->negative)
+      pulse.flags ^= PULSE_FLAG_NEGATIVE;
 
-typedef struct {
-   uint8_t state_index; // The current "waveform" state (e.g. off, on_ramp, on).
+   if (!output_pulse_burst(ch_index, &pulse))
+      return false;
 
-   uint32_t last_power_time_us; // The absolute timestamp since the last power update occurred.
-   uint32_t last_pulse_time_us; // The absolute timestamp since the last pulse occurred.
+   if (pulse_shape_alternates(&pulse))
+      gen->negative = !gen->negative;
+   return true;
+}
 
-   uint32_t last_state_time_us; // The absolute timestamp since the last "waveform" state change (e.g. off -> on_ramp -> on).
+// Drop queued lookahead pulses that aren't about to be output, rewinding the pulse timebase so they are planned again.
+static void lookahead_invalidate(generator_t* gen, uint8_t ch_index, uint32_t now_us) {
+   if (gen->pulse_nco.period_us == 0 || gen->pulse_nco.restart)
+      return; // Nothing planned
 
-   parameter_t parameters[TOTAL_PARAMS];
-} generator_t;
+   const uint32_t from_us = now_us + LOOKAHEAD_GUARD_US;
 
-static inline void parameter_step(uint8_t ch_index, param_t param);
-static inline void execute_action(uint8_t a_index, uint8_t nest_count);
+   // Rewind past every pulse at or after the cutoff
+   uint8_t rewound = 0;
+   for (;;) {
+      nco_t prev = gen->pulse_nco;
+      nco_rewind(&prev);
+      if (!deadline_reached(from_us, prev.next_time_us))
+         break;
 
-static generator_t generators[CHANNEL_COUNT] = {0};
+      gen->pulse_nco = prev;
+      rewound++;
+   }
 
-static uint32_t last_sequence_time_us = 0;
+   if (rewound == 0)
+      return;
 
-pulse_gen_t pulse_gen = {0};
+   output_pulse_invalidate(ch_index, from_us);
 
-void pulse_gen_init() {
-   LOG_DEBUG("Init pulse generator...\n");
+   if (pulse_shape_alternates(&gen->planned) && (rewound & 1))
+      gen->negative = !gen->negative;
 
-   // Set default parameter values
-   for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
-      parameter_set(ch_index, PARAM_POWER, TARGET_MAX, UINT16_MAX);   // max. 100% (auto cycle limit)
-      parameter_set(ch_index, PARAM_POWER, TARGET_VALUE, UINT16_MAX); // 100%
+   gen->rate_count -= MIN(gen->rate_count, rewound); // Replanned pulses are counted again
+}
 
-      parameter_set(ch_index, PARAM_FREQUENCY, TARGET_MAX, 5000);   // max. 500 Hz (auto cycle limit)
-      parameter_set(ch_index, PARAM_FREQUENCY, TARGET_VALUE, 1800); // 180 Hz
+// Pulse frequency of the channel in dHz (Q8), including the fractional part and limited to the max frequency. Zero if pulses are disabled.
+static inline uint32_t channel_freq_q8(uint8_t ch_index) {
+   return derived_get(ch_index)->freq_q8;
+}
 
-      parameter_set(ch_index, PARAM_PULSE_WIDTH, TARGET_MAX, 500);   // max. 500 us (auto cycle limit)
-      parameter_set(ch_index, PARAM_PULSE_WIDTH, TARGET_VALUE, 150); // 150 us
+// Measure the pulse rate from the actual pulse times, over windows of continuous pulsing. Pulses after a gap (resync) start a new window.
+static inline void rate_measure(generator_t* gen, uint32_t now_us, bool resynced) {
+   if (resynced) {
+      gen->rate_time_us = now_us;
+      gen->rate_count = 0;
+      return;
+   }
 
-      parameter_set(ch_index, PARAM_ON_TIME, TARGET_MAX, 10000);      // max. 10 seconds (auto cycle limit)
-      parameter_set(ch_index, PARAM_ON_RAMP_TIME, TARGET_MAX, 5000);  // max. 5 seconds (auto cycle limit)
-      parameter_set(ch_index, PARAM_OFF_TIME, TARGET_MAX, 10000);     // max. 10 seconds (auto cycle limit)
-      parameter_set(ch_index, PARAM_OFF_RAMP_TIME, TARGET_MAX, 5000); // max. 5 seconds (auto cycle limit)
+   gen->rate_count++; // Count of periods since the window started
+
+   const uint32_t elapsed_us = now_us - gen->rate_time_us;
+   if (elapsed_us >= RATE_WINDOW_US) {
+      gen->measured_freq_q8 = ((uint64_t)gen->rate_count * (10000000ull << 8)) / elapsed_us;
+      gen->rate_time_us = now_us;
+      gen->rate_count = 0;
    }
 }
 
-static inline uint32_t state_time_us(uint8_t ch_index) {
-   return parameter_get(ch_index, STATE_SEQUENCE[generators[ch_index].state_index], TARGET_VALUE) * 1000u;
+void pulse_gen_rate(uint8_t ch_index, rate_stats_t* stats) {
+   const generator_t* const gen = &generators[ch_index];
+
+   stats->freq_q8 = gen->pulse_freq_q8;
+   stats->measured_freq_q8 = gen->measured_freq_q8;
+   stats->error_ppm = gen->pulse_freq_q8 ? (((int64_t)gen->measured_freq_q8 - gen->pulse_freq_q8) * 1000000) / gen->pulse_freq_q8 : 0;
+   stats->resyncs = gen->pulse_nco.resyncs;
 }
 
-void pulse_gen_process() {
-   uint8_t sequencer_mask;
-   if (pulse_gen.sequencer.period_us == 0 || pulse_gen.sequencer.count == 0) {
-      sequencer_mask = 0xff; // If sequencer is disabled, mask all enabled
+void pulse_gen_preview(uint8_t ch_index, preview_channel_t* preview) {
+   generator_t* const gen = &generators[ch_index];
+   const uint32_t now_us = time_us_32();
+
+   const derived_t* const derived = derived_get(ch_index);
+   preview->freq_q8 = derived->freq_q8;
+   memcpy(preview->state_time_us, derived->state_time_us, sizeof(preview->state_time_us));
+
+   preview->power = parameter_get(ch_index, PARAM_POWER, TARGET_VALUE);
+   preview->power_max = parameter_get(ch_index, PARAM_POWER, TARGET_MAX);
+   preview->pulse_width = parameter_get(ch_index, PARAM_PULSE_WIDTH, TARGET_VALUE);
+   preview->power_mode = pulse_gen->channels[ch_index].power_mode;
+   memcpy(preview->power_lut, pulse_gen->channels[ch_index].power_lut, sizeof(preview->power_lut));
+
+   const uint8_t curve = pulse_gen->channels[ch_index].ramp_curve;
+   if (!gen->ramp_built || gen->ramp_curve != curve)
+      ramp_table_build(gen, curve);
+   memcpy(preview->ramp_table, gen->ramp_table, sizeof(preview->ramp_table));
+
+   preview->enabled = (pulse_gen->en_mask & sequencer_mask()) & (1 << ch_index);
+
+   if (!gen->running) { // Starts from the first state once processed
+      preview->state_index = 0;
+      preview->state_elapsed_us = 0;
    } else {
+      preview->state_index = gen->state_index;
+      preview->state_elapsed_us = now_us - gen->last_state_time_us;
+   }
 
-      if ((time_us_32() - last_sequence_time_us) > pulse_gen.sequencer.period_us) {
-         last_sequence_time_us = time_us_32();
+   preview->next_pulse_us = 0;
+   preview->pulse_acc = 0;
 
-         if (++pulse_gen.sequencer.index >= pulse_gen.sequencer.count)
-            pulse_gen.sequencer.index = 0; // Increment or reset after count
+   // Continue the pulse timebase if it's running at the configured frequency. Queued lookahead pulses haven't been output yet, so step back over them.
+   if (gen->running && !gen->pulse_nco.restart && gen->pulse_nco.period_us != 0 && gen->pulse_freq_q8 == derived->freq_q8) {
+      nco_t nco = gen->pulse_nco;
+      for (;;) {
+         nco_t prev = nco;
+         nco_rewind(&prev);
+         if (!deadline_reached(now_us, prev.next_time_us))
+            break;
+         nco = prev;
       }
 
-      if (pulse_gen.sequencer.index >= MAX_SEQUENCES)
-         pulse_gen.sequencer.index = MAX_SEQUENCES - 1;
+      preview->next_pulse_us = deadline_reached(nco.next_time_us, now_us) ? 0 : nco.next_time_us - now_us;
+      preview->pulse_acc = nco.period_acc;
+   }
+}
+
+// Advance the shared group timebase. The group frequency is the frequency of the lowest index member (the leader).
+// Called by every member, the first member to see an event advances the timebase, so each event occurs once.
+static void group_process(uint8_t group_index, uint32_t now_us) {
+   group_t* const grp = &groups[group_index];
+
+   uint8_t leader = 0;
+   while (leader < CHANNEL_COUNT && pulse_gen->channels[leader].group != group_index + 1)
+      leader++;
+
+   const uint32_t freq_q8 = leader < CHANNEL_COUNT ? channel_freq_q8(leader) : 0;
+   if (freq_q8 == 0) {
+      grp->nco.restart = true; // Restart in phase once pulses are enabled again
+      return;
+   }
+
+   if (freq_q8 != grp->freq_q8) {
+      grp->freq_q8 = freq_q8;
+      nco_set_period(&grp->nco, (10000000ull << 40) / freq_q8);
+   }
 
-      sequencer_mask = pulse_gen.sequencer.masks[pulse_gen.sequencer.index];
+   if (nco_due(&grp->nco, now_us)) {
+      grp->event_time_us = grp->nco.next_time_us;
+      grp->event_seq++;
+      nco_advance(&grp->nco);
    }
+}
 
-   // Currently enabled channel mask
-   const uint8_t en = pulse_gen.en_mask & sequencer_mask;
+// Generate a pulse for each group timebase event, offset by the member phase.
+static void group_member_process(generator_t* gen, uint8_t ch_index, uint8_t group_index, uint16_t pulse_width, uint32_t now_us, uint32_t* deadline_us) {
+   const group_t* const grp = &groups[group_index];
 
-   for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
-      generator_t* const gen = &generators[ch_index];
+   group_process(group_index, now_us);
+   if (grp->freq_q8 == 0 || grp->nco.restart)
+      return;
 
-      if (~en & (1 << ch_index)) { // When disabled, hold state at zero
-         gen->state_index = 0;
-         gen->last_state_time_us = time_us_32();
-         continue;
+   deadline_min(deadline_us, grp->nco.next_time_us);
+
+   if (!gen->group_synced) { // Joined (or restarted) mid period, so wait for the next event to stay in phase
+      gen->group_synced = true;
+      gen->group_seq = grp->event_seq;
+      return;
+   }
+
+   if (gen->group_seq == grp->event_seq)
+      return;
+   gen->group_seq = grp->event_seq;
+
+   // Phase offset as a fraction of the group period, pulse output is timestamped so this is exact regardless of processing order
+   const uint32_t offset_us = ((uint64_t)grp->nco.period_us * pulse_gen->channels[ch_index].phase) >> 16;
+
+   generator_pulse(gen, ch_index, pulse_width, grp->event_time_us + offset_us + 110); // ~110us for DAC write
+   gen->last_pulse_time_us = grp->event_time_us + offset_us;
+
+   gen->pulse_freq_q8 = grp->freq_q8;
+   rate_measure(gen, now_us, false);
+}
+
+static uint32_t generator_process(uint8_t ch_index, uint32_t now_us) {
+   generator_t* const gen = &generators[ch_index];
+
+   // Nothing needs processing until something changes (which reschedules), so idle as long as possible
+   uint32_t deadline_us = now_us + SCHED_IDLE_PERIOD_US;
+
+   if (~(pulse_gen->en_mask & sequencer_mask()) & (1 << ch_index)) { // When disabled, hold state at zero
+      if (gen->running)
+         lookahead_invalidate(gen, ch_index, now_us); // Cancel queued pulses
+
+      gen->running = false;
+      gen->state_index = 0;
+      return deadline_us;
+   }
+
+   if (!gen->running) { // Restart "waveform" state from the time the channel got enabled
+      gen->running = true;
+      gen->last_state_time_us = now_us;
+      gen->pulse_nco.restart = true;
+      gen->group_synced = false;
+   }
+
+   // Recompute step/period of parameters whose targets changed since the last update
+   for (uint8_t mask = gen->stale_mask; mask; mask &= mask - 1)
+      parameter_update(ch_index, __builtin_ctz(mask));
+
+   // Update dynamic parameters, skipping static ones
+   for (uint8_t mask = gen->sweep_mask; mask; mask &= mask - 1)
+      parameter_step(ch_index, __builtin_ctz(mask), now_us, &deadline_us);
+
+   // Pulses are planned ahead up to the horizon, but never past the end of the current state
+   uint32_t horizon_us = now_us + MIN(pulse_gen->lookahead_us, MAX_LOOKAHEAD_US);
+
+   // Update "waveform" state, states with zero duration are skipped
+   const derived_t* const derived = derived_get(ch_index);
+   if (state_advance(derived->state_time_us, &gen->state_index, &gen->last_state_time_us, now_us)) {
+      const uint32_t state_end_us = gen->last_state_time_us + derived->state_time_us[gen->state_index];
+      deadline_min(&deadline_us, state_end_us);
+      deadline_min(&horizon_us, state_end_us);
+   }
+
+   uint16_t power_level = parameter_get(ch_index, PARAM_POWER, TARGET_VALUE);
+   if (power_level == 0)
+      return deadline_us;
+
+   uint16_t power = power_level;
+
+   // Scale power level depending on the current "waveform" state (e.g. transition between off and on)
+   param_t channel_state = STATE_SEQUENCE[gen->state_index];
+   switch (channel_state) {
+      case PARAM_ON_RAMP_TIME:    // Ramp power from zero to power value
+      case PARAM_OFF_RAMP_TIME: { // Ramp power from power value to zero
+         const uint16_t ramp_time_ms = parameter_get(ch_index, channel_state, TARGET_VALUE);
+         if (ramp_time_ms == 0)
+            break;
+
+         const uint32_t elapsed = now_us - gen->last_state_time_us;
+
+         power = q16_mul(power, ramp_modifier(ch_index, channel_state == PARAM_OFF_RAMP_TIME, ramp_time_ms, elapsed));
+         break;
       }
 
-      // Update dynamic parameters
-      for (uint8_t i = 0; i < TOTAL_PARAMS; i++)
-         parameter_step(ch_index, i);
+      case PARAM_OFF_TIME: // If the state is off, skip channel without pulsing
+         return deadline_us;
+      default:
+         break;
+   }
+
+   uint16_t pulse_width = parameter_get(ch_index, PARAM_PULSE_WIDTH, TARGET_VALUE);
+   if (pulse_width == 0) {
+      lookahead_invalidate(gen, ch_index, now_us);
+      return deadline_us;
+   }
+
+   uint8_t audio = pulse_gen->channels[ch_index].audio;
+   analog_channel_t audio_src = audio & ~AUDIO_MODE_FLAG;
+
+   // Channel has audio source and a mode, so process audio
+   if (audio_src && (audio & AUDIO_MODE_FLAG)) {
+
+      extern uint16_t audio_process(analog_channel_t audio_src, bool gen_zcs, uint8_t ch_index, uint16_t pulse_width_us, uint32_t min_period_us,
+                                 uint32_t* last_pulse_time_us);
+
+      // Process audio by generating pulses at zero crossings if enabled and return computed audio amplitude.
+      bool gen_zcs = !!(audio & AUDIO_MODE_FLAG_PULSE);
+      uint16_t amplitude = audio_process(audio_src, gen_zcs, ch_index, pulse_width, HZ_TO_US(MAX_FREQUENCY_HZ), &gen->last_pulse_time_us);
+
+      if (audio & AUDIO_MODE_FLAG_POWER) // Apply amplitude to output power
+         power = q16_mul(power, amplitude);
+
+      // Audio buffers arrive asynchronously, so poll for them
+      deadline_min(&deadline_us, now_us + AUDIO_POLL_PERIOD_US);
+   }
+
+   // Hold the DAC at the power ceiling and apply the power to each pulse width instead, so fast changes aren't limited by DAC updates
+   if (pulse_gen->channels[ch_index].power_mode == POWER_MODE_WIDTH) {
+      const uint16_t power_max = parameter_get(ch_index, PARAM_POWER, TARGET_MAX);
+
+      pulse_width = width_power_scale(pulse_gen->channels[ch_index].power_lut, pulse_width, power, power_max);
+      power = power_max;
+   }
+
+   // Set channel output power, limit updates to ~4.5 kHz since a DAC fast write takes about ~55us/ch
+   if ((now_us - gen->last_power_time_us) > POWER_UPDATE_PERIOD_US) {
+      gen->last_power_time_us = now_us;
+      output_power(ch_index, power);
+   }
+   deadline_min(&deadline_us, gen->last_power_time_us + POWER_UPDATE_PERIOD_US + 1);
+
+   if (pulse_width == 0) { // Power scaled the width to nothing
+      lookahead_invalidate(gen, ch_index, now_us);
+      return deadline_us;
+   }
+
+   // Phase locked channels pulse from their group timebase instead
+   const uint8_t group = pulse_gen->channels[ch_index].group;
+   if (group > 0 && group <= MAX_GROUPS) {
+      group_member_process(gen, ch_index, group - 1, pulse_width, now_us, &deadline_us);
+      return deadline_us;
+   }
+
+   const uint32_t freq_q8 = derived->freq_q8;
+   if (freq_q8 == 0) {
+      lookahead_invalidate(gen, ch_index, now_us);
+      return deadline_us;
+   }
+
+   // Replan queued pulses if their shape or period changed, or if any are past the horizon (e.g. state time or lookahead reduced)
+   pulse_t shape;
+   pulse_shape(ch_index, pulse_width, &shape);
+   if (freq_q8 != gen->pulse_freq_q8 || !pulse_shape_equal(&shape, &gen->planned) ||
+       !deadline_reached(gen->pulse_nco.next_time_us - gen->pulse_nco.period_us, horizon_us))
+      lookahead_invalidate(gen, ch_index, now_us);
+   gen->planned = shape;
+
+   if (freq_q8 != gen->pulse_freq_q8) { // Period = 1e7 / dHz microseconds, only recomputed when the frequency changes since 64-bit division is slow
+      gen->pulse_freq_q8 = freq_q8;
+      nco_set_period(&gen->pulse_nco, (10000000ull << 40) / freq_q8);
+   }
+
+   // Generate pulses, queueing them ahead up to the horizon
+   for (;;) {
+      const uint32_t resyncs = gen->pulse_nco.resyncs;
+      const bool restarting = gen->pulse_nco.restart;
+      if (!nco_due_before(&gen->pulse_nco, now_us, horizon_us))
+         break;
+
+      // Pulse output is timestamped, so emit it at the ideal time to remove loop jitter
+      if (!generator_pulse(gen, ch_index, pulse_width, gen->pulse_nco.next_time_us + 110)) // ~110us for DAC write
+         break;                                                                              // Output queue is full, retry later
+      gen->last_pulse_time_us = gen->pulse_nco.next_time_us;
 
-      // Update "waveform" state
-      if ((time_us_32() - gen->last_state_time_us) > state_time_us(ch_index)) {
-         gen->last_state_time_us = time_us_32();
+      nco_advance(&gen->pulse_nco);
+      rate_measure(gen, now_us, restarting || gen->pulse_nco.resyncs != resyncs);
+   }
+   deadline_min(&deadline_us, gen->pulse_nco.next_time_us - (horizon_us - now_us));
+
+   return deadline_us;
+}
+
+void pulse_gen_process() {
+   if (config_commit_pending)
+      config_apply(); // Swap in staged configuration between passes, so a pass never sees a partial configuration
+
+   if (!sched_due)
+      return; // Nothing is due, no work until the next deadline
+   sched_due = false;
+
+   const uint32_t now_us = time_us_32();
+
+   if (sched_dirty) { // Configuration changed, so re-evaluate every slot
+      sched_dirty = false;
+      sched_marked = 0;
 
-         if (++gen->state_index >= STATE_COUNT)
-            gen->state_index = 0; // Increment or reset after 4 states (on_ramp, on, off_ramp, off)
+      sched_heap_size = 0;
+      for (uint8_t slot = 0; slot < SCHED_SLOTS; slot++)
+         sched_push(slot, now_us);
+   } else if (sched_marked) {
+      sched_marked_apply(now_us);
+   }
+
+   // Process every slot whose deadline has passed, in deadline order
+   while (deadline_reached(sched_heap[0].deadline_us, now_us)) {
+      const sched_entry_t entry = sched_pop();
+
+      uint32_t deadline_us;
+      if (entry.slot == SCHED_SLOT_SEQUENCER) {
+         deadline_us = sequencer_process(now_us);
+      } else if (entry.slot == SCHED_SLOT_TIMERS) {
+         deadline_us = timer_wheel_process(now_us);
+      } else if (entry.slot == SCHED_SLOT_MOD) {
+         deadline_us = mod_process(now_us);
+      } else if (entry.slot == SCHED_SLOT_TIMELINE) {
+         deadline_us = timeline_process(now_us);
+      } else if (entry.slot == SCHED_SLOT_FADE) {
+         deadline_us = fade_process(now_us);
+      } else {
+         deadline_us = generator_process(entry.slot, now_us);
       }
 
-      uint16_t power_level = parameter_get(ch_index, PARAM_POWER, TARGET_VALUE);
-      if (power_level == 0)
-         continue;
+      // Always move forward, so a slot is processed at most once per pass
+      if (deadline_reached(deadline_us, now_us))
+         deadline_us = now_us + 1;
 
-      float power = (float)power_level / UINT16_MAX;
+      sched_push(entry.slot, deadline_us);
+   }
 
-      // Scale power level depending on the current "waveform" state (e.g. transition between off and on)
-      param_t channel_state = STATE_SEQUENCE[gen->state_index];
-      switch (channel_state) {
-         case PARAM_ON_RAMP_TIME:    // Ramp power from zero to power value
-         case PARAM_OFF_RAMP_TIME: { // Ramp power from power value to zero
-            uint32_t ramp_time = state_time_us(ch_index);
-            if (ramp_time == 0)
-               break;
+   sched_arm(sched_heap[0].deadline_us);
+}
 
-            uint32_t elapsed = time_us_32() - gen->last_state_time_us;
+// Flatten the action range into ops, inlining ACTION_EXECUTE chains. Disabled and invalid actions are dropped.
+// path is a bitmask of ACTION_EXECUTE action indices currently being inlined, used to reject cycles.
+static compile_result_t action_list_compile(const pulse_gen_t* cfg, action_list_t* list, uint8_t al_start, uint8_t al_end, uint32_t path[], uint8_t depth) {
+   if (depth > ACTION_CACHE_MAX_DEPTH)
+      return COMPILE_DEPTH;
 
-            float state_modifier = (float)elapsed / ramp_time;
-            if (state_modifier > 1.0f)
-               state_modifier = 1.0f;
+   for (size_t a_index = al_start; a_index < al_end && a_index < MAX_ACTIONS; a_index++) {
+      const action_t* const action = &cfg->actions[a_index];
 
-            if (channel_state == PARAM_OFF_RAMP_TIME)
-               state_modifier = 1.0f - state_modifier; // Invert if transition is going from on to off.
+      if (!action->enabled)
+         continue;
 
-            power *= state_modifier;
+      switch (action->type) {
+         case ACTION_SET:
+         case ACTION_INCREMENT:
+         case ACTION_DECREMENT:
+         case ACTION_RAMP_TO:
+            if (action->param >= TOTAL_PARAMS || action->target >= TOTAL_TARGETS)
+               continue;
             break;
-         }
+         case ACTION_PARAM_UPDATE:
+            if (action->param >= TOTAL_PARAMS)
+               continue;
+            break;
+         case ACTION_ENABLE:
+         case ACTION_DISABLE:
+         case ACTION_TOGGLE:
+            break;
+         case ACTION_EXECUTE: { // Inline the other action list
+            if (path[a_index / 32] & (1u << (a_index % 32)))
+               return COMPILE_CYCLE;
 
-         case PARAM_OFF_TIME: // If the state is off, continue to next channel without pulsing
+            path[a_index / 32] |= (1u << (a_index % 32));
+            const compile_result_t ret = action_list_compile(cfg, list, action->value >> 8, action->value & 0xff, path, depth + 1); // start:upper byte, end: lower byte
+            path[a_index / 32] &= ~(1u << (a_index % 32));
+
+            if (ret != COMPILE_OK)
+               return ret;
+            continue;
+         }
+         default: // ACTION_NONE and unknown types
             continue;
-         default:
-            break;
       }
 
-      uint16_t pulse_width = parameter_get(ch_index, PARAM_PULSE_WIDTH, TARGET_VALUE);
-      if (pulse_width == 0)
-         continue;
+      if (list->count >= ACTION_CACHE_MAX_OPS)
+         return COMPILE_OVERFLOW;
+
+      list->ops[list->count++] = (action_op_t){
+          .type = action->type,
+          .ch_mask = action->ch_mask,
+          .param = action->param,
+          .target = action->target,
+          .value = action->value,
+          .duration_ms = action->duration_ms,
+      };
+   }
 
-      uint8_t audio = pulse_gen.channels[ch_index].audio;
-      analog_channel_t audio_src = audio & ~AUDIO_MODE_FLAG;
+   return COMPILE_OK;
+}
 
-      // Channel has audio source and a mode, so process audio
-      if (audio_src && (audio & AUDIO_MODE_FLAG)) {
+// Compile the action range into the cache entry. Lists that fail to compile are cached empty, so they do nothing when executed.
+static void action_cache_build(action_list_t* list, uint8_t al_start, uint8_t al_end) {
+   uint32_t path[(MAX_ACTIONS + 31) / 32] = {0};
 
-         extern float audio_process(analog_channel_t audio_src, bool gen_zcs, uint8_t ch_index, uint16_t pulse_width_us, uint32_t min_period_us,
-                                    uint32_t* last_pulse_time_us);
+   list->valid = true;
+   list->al_start = al_start;
+   list->al_end = al_end;
+   list->count = 0;
 
-         // Process audio by generating pulses at zero crossings if enabled and return computed audio amplitude.
-         bool gen_zcs = !!(audio & AUDIO_MODE_FLAG_PULSE);
-         float amplitude = audio_process(audio_src, gen_zcs, ch_index, pulse_width, HZ_TO_US(MAX_FREQUENCY_HZ), &gen->last_pulse_time_us);
+   const compile_result_t ret = action_list_compile(pulse_gen, list, al_start, al_end, path, 0);
+   if (ret != COMPILE_OK) {
+      LOG_WARN("Action list compile failed! Ignoring list: al=%u-%u ret=%u", al_start, al_end, ret);
+      list->count = 0;
+   }
+}
 
-         if (audio & AUDIO_MODE_FLAG_POWER) // Apply amplitude to output power
-            power *= amplitude;
-      }
+// Find the compiled action list for the range, compiling it on a miss.
+static const action_list_t* action_cache_get(uint8_t al_start, uint8_t al_end) {
+   for (size_t i = 0; i < ACTION_CACHE_SIZE; i++) {
+      const action_list_t* const list = &action_cache[i];
+      if (list->valid && list->al_start == al_start && list->al_end == al_end)
+         return list;
+   }
 
-      // Set channel output power, limit updates to ~2.2 kHz since it takes the DAC about ~110us/ch
-      if ((time_us_32() - gen->last_power_time_us) > 110 * CHANNEL_COUNT) {
-         gen->last_power_time_us = time_us_32();
-         output_power(ch_index, power);
-      }
+   action_list_t* const list = &action_cache[action_cache_next];
+   action_cache_next = (action_cache_next + 1) % ACTION_CACHE_SIZE;
 
-      uint16_t frequency = parameter_get(ch_index, PARAM_FREQUENCY, TARGET_VALUE);
-      if (frequency == 0)
-         continue;
+   action_cache_build(list, al_start, al_end);
+   return list;
+}
+
+// Recompile cached lists, since any of them could include changed actions
+static void action_cache_rebuild() {
+   for (size_t i = 0; i < ACTION_CACHE_SIZE; i++) {
+      action_list_t* const list = &action_cache[i];
+      if (list->valid)
+         action_cache_build(list, list->al_start, list->al_end);
+   }
+}
+
+bool action_set(uint8_t a_index, const action_t* action) {
+   if (a_index >= MAX_ACTIONS)
+      return false;
 
-      uint32_t period_us = DHZ_TO_US(frequency);
-      if (period_us < HZ_TO_US(MAX_FREQUENCY_HZ)) // limit max frequency
-         period_us = HZ_TO_US(MAX_FREQUENCY_HZ);
+   pulse_gen_t* const cfg = pulse_gen_config();
 
-      // Generate pulse
-      if ((time_us_32() - gen->last_pulse_time_us) > period_us) {
-         gen->last_pulse_time_us = time_us_32();
+   const action_t previous = cfg->actions[a_index];
+   cfg->actions[a_index] = *action;
 
-         output_pulse(ch_index, pulse_width, pulse_width, time_us_32() + 110); // ~110us for DAC write
+   // Reject actions that would create an ACTION_EXECUTE cycle (or nest too deep), by compiling the range from the written action.
+   if (action->enabled && action->type == ACTION_EXECUTE) {
+      static action_list_t scratch;
+      uint32_t path[(MAX_ACTIONS + 31) / 32] = {0};
+      path[a_index / 32] |= (1u << (a_index % 32));
+
+      scratch.count = 0;
+      const compile_result_t ret = action_list_compile(cfg, &scratch, action->value >> 8, action->value & 0xff, path, 1);
+      if (ret == COMPILE_CYCLE || ret == COMPILE_DEPTH) {
+         LOG_WARN("Action rejected! index=%u al=%u-%u ret=%u", a_index, action->value >> 8, action->value & 0xff, ret);
+         cfg->actions[a_index] = previous;
+         return false;
       }
    }
+
+   if (cfg == pulse_gen) // Staged actions are compiled on commit
+      action_cache_rebuild();
+   return true;
+}
+
+bool mod_route_set(uint8_t r_index, const mod_route_t* route) {
+   if (r_index >= MAX_MOD_ROUTES || !mod_route_valid(route))
+      return false;
+
+   pulse_gen_t* const cfg = pulse_gen_config();
+   cfg->mod_routes[r_index] = *route;
+
+   if (cfg == pulse_gen) // Staged routes are compiled on commit
+      mod_routes_compile();
+   return true;
+}
+
+bool timeline_step_set(uint8_t s_index, const timeline_step_t* step) {
+   if (s_index >= MAX_TIMELINE_STEPS || step->scene_start + step->scene_count > MAX_SCENE_ENTRIES)
+      return false;
+
+   pulse_gen_t* const cfg = pulse_gen_config();
+   cfg->timeline.steps[s_index] = *step;
+
+   if (cfg == pulse_gen) // Staged steps are compiled on commit
+      timeline_compile();
+   return true;
 }
 
-// Alarm callback function for disabling channel pulse generation using a channel mask
-static int64_t ch_gen_mask_disable_cb(alarm_id_t id, void* user_data) {
-   (void)id;
-   const uint8_t channel_mask = (int)user_data;
-   pulse_gen.en_mask &= ~channel_mask;
-   return 0; // Dont reschedule the alarm
+bool scene_entry_set(uint8_t e_index, const scene_entry_t* entry) {
+   if (e_index >= MAX_SCENE_ENTRIES || entry->param >= TOTAL_PARAMS || entry->target >= TOTAL_TARGETS)
+      return false;
+
+   pulse_gen_t* const cfg = pulse_gen_config();
+   cfg->timeline.scenes[e_index] = *entry;
+
+   if (cfg == pulse_gen) // Staged entries are compiled on commit
+      timeline_compile();
+   return true;
 }
 
-// Alarm callback function for enabling channel pulse generation using a channel mask
-static int64_t ch_gen_mask_enable_cb(alarm_id_t id, void* user_data) {
-   (void)id;
-   const uint8_t channel_mask = (int)user_data;
-   pulse_gen.en_mask |= channel_mask;
-   return 0; // Dont reschedule the alarm
+void timeline_count_set(uint8_t count) {
+   pulse_gen_t* const cfg = pulse_gen_config();
+   cfg->timeline.count = MIN(count, MAX_TIMELINE_STEPS);
+
+   if (cfg == pulse_gen) // Staged count is compiled on commit
+      timeline_compile();
 }
 
-// Alarm callback function for toggling channel pulse generation using a channel mask
-static int64_t ch_gen_mask_toggle_cb(alarm_id_t id, void* user_data) {
-   (void)id;
-   const uint8_t channel_mask = (int)user_data;
-   pulse_gen.en_mask ^= channel_mask;
-   return 0; // Dont reschedule the alarm
+void morph_bank_set(uint8_t bank, uint8_t ch_index, param_t param, target_t target, uint16_t value) {
+   if (bank >= MORPH_BANKS || ch_index >= CHANNEL_COUNT || param >= TOTAL_PARAMS || target >= TOTAL_TARGETS)
+      return;
+
+   pulse_gen_t* const cfg = pulse_gen_config();
+   cfg->morph.banks[bank][ch_index][param][target] = value;
+   cfg->morph.captured[bank][ch_index][param] |= (1 << target);
+
+   if (cfg == pulse_gen) // Staged banks are compiled on commit
+      morph_compile();
 }
 
-static void execute_action_list_nested(uint8_t al_start, uint8_t al_end, uint8_t nest_count) {
-   if (nest_count > 2) {
-      LOG_WARN("Max recursion depth reached! Ignoring invocation: al=%u-%u depth=%u", al_start, al_end, nest_count);
+void morph_bank_capture(uint8_t bank) {
+   if (bank >= MORPH_BANKS)
       return;
+
+   pulse_gen_t* const cfg = pulse_gen_config();
+   for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+      memcpy(cfg->morph.banks[bank][ch_index], cfg->channels[ch_index].parameters, sizeof(cfg->channels[ch_index].parameters));
+      memset(cfg->morph.captured[bank][ch_index], (1 << TOTAL_TARGETS) - 1, sizeof(cfg->morph.captured[bank][ch_index]));
    }
 
-   for (uint8_t i = al_start; i < al_end; i++)
-      execute_action(i, nest_count);
+   if (cfg == pulse_gen)
+      morph_compile();
 }
 
-// Execute the action at the given action slot index
-static inline void execute_action(uint8_t a_index, uint8_t nest_count) {
-   if (a_index >= MAX_ACTIONS)
-      return;
+void morph_set(bool enabled, uint16_t position) {
+   pulse_gen_t* const cfg = pulse_gen_config();
+   const bool was_enabled = cfg->morph.enabled;
 
-   action_t* const action = &pulse_gen.actions[a_index];
+   cfg->morph.enabled = enabled;
+   cfg->morph.position = position;
 
-   if (!action->enabled || action->type == ACTION_NONE)
+   if (cfg != pulse_gen) // Staged state is compiled on commit
       return;
 
-   switch (action->type) {
+   if (enabled != was_enabled) {
+      morph_compile();
+   } else if (enabled) {
+      morph_apply(); // Only the position changed, so the ops are still valid
+   }
+}
+
+// Execute a compiled op. Ops are validated when compiled, so no checks are needed here.
+static inline void execute_op(const action_op_t* op) {
+   switch (op->type) {
       case ACTION_SET:
       case ACTION_INCREMENT:
       case ACTION_DECREMENT: { // set,increment,decrement param+target value for all channels in mask, while keeping it constrained to TARGET_MIN/MAX
-
-         if (action->param >= TOTAL_PARAMS || action->target >= TOTAL_TARGETS)
-            return;
-
-         uint16_t val = action->value;
+         uint16_t val = op->value;
          for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
-            if (~action->ch_mask & (1 << ch_index))
+            if (~op->ch_mask & (1 << ch_index))
                continue;
 
-            if (action->type == ACTION_INCREMENT) {
-               val = parameter_get(ch_index, action->param, action->target) + action->value;
-            } else if (action->type == ACTION_DECREMENT) {
-               val = parameter_get(ch_index, action->param, action->target) - action->value;
+            if (op->type == ACTION_INCREMENT) {
+               val = parameter_get(ch_index, op->param, op->target) + op->value;
+            } else if (op->type == ACTION_DECREMENT) {
+               val = parameter_get(ch_index, op->param, op->target) - op->value;
             }
 
-            if (action->target == TARGET_VALUE) { // Limit target value between TARGET_MIN and TARGET_MAX
-               const uint16_t min = parameter_get(ch_index, action->param, TARGET_MIN);
-               const uint16_t max = parameter_get(ch_index, action->param, TARGET_MAX);
+            if (op->target == TARGET_VALUE) { // Limit target value between TARGET_MIN and TARGET_MAX
+               const uint16_t min = parameter_get(ch_index, op->param, TARGET_MIN);
+               const uint16_t max = parameter_get(ch_index, op->param, TARGET_MAX);
 
                if (val > max) {
                   val = max;
@@ -277,149 +1819,277 @@ static inline void execute_action(uint8_t a_index, uint8_t nest_count) {
                }
             }
 
-            parameter_set(ch_index, action->param, action->target, val);
+            parameter_set(ch_index, op->param, op->target, val);
          }
          break;
       }
       case ACTION_ENABLE: // Enable channel generation for mask, with optional delayed disable in milliseconds
-         pulse_gen.en_mask |= action->ch_mask;
-         if (action->value > 0 && action->ch_mask) // add_alarm_in_ms doesn't copy user_data, so use user_data as the value instead of a pointer
-            add_alarm_in_ms(action->value, ch_gen_mask_disable_cb, (void*)((int)action->ch_mask), true);
+         pulse_gen->en_mask |= op->ch_mask;
+         if (op->value > 0 && op->ch_mask)
+            timer_wheel_add(ACTION_DISABLE, op->ch_mask, op->value);
          break;
       case ACTION_DISABLE: // Disable channel generation for mask, with optional delayed enable in milliseconds
-         pulse_gen.en_mask &= ~action->ch_mask;
-         if (action->value > 0 && action->ch_mask) // add_alarm_in_ms doesn't copy user_data, so use user_data as the value instead of a pointer
-            add_alarm_in_ms(action->value, ch_gen_mask_enable_cb, (void*)((int)action->ch_mask), true);
+         pulse_gen->en_mask &= ~op->ch_mask;
+         if (op->value > 0 && op->ch_mask)
+            timer_wheel_add(ACTION_ENABLE, op->ch_mask, op->value);
          break;
       case ACTION_TOGGLE: // Toggle channel generation for mask, with optional delayed toggle in milliseconds
-         pulse_gen.en_mask ^= action->ch_mask;
-         if (action->value > 0 && action->ch_mask) // add_alarm_in_ms doesn't copy user_data, so use user_data as the value instead of a pointer
-            add_alarm_in_ms(action->value, ch_gen_mask_toggle_cb, (void*)((int)action->ch_mask), true);
-         break;
-      case ACTION_EXECUTE:                                                                     // Run another action list from this list
-         execute_action_list_nested(action->value >> 8, action->value & 0xff, nest_count + 1); // start:upper byte, end: lower byte
+         pulse_gen->en_mask ^= op->ch_mask;
+         if (op->value > 0 && op->ch_mask)
+            timer_wheel_add(ACTION_TOGGLE, op->ch_mask, op->value);
          break;
       case ACTION_PARAM_UPDATE: { // Update parameter step/rate using channel mask
          for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
-            if (action->ch_mask & (1 << ch_index))
-               parameter_update(ch_index, action->param);
+            if (op->ch_mask & (1 << ch_index))
+               parameter_update(ch_index, op->param);
          }
          break;
       }
+      case ACTION_RAMP_TO: // Ramp param+target value for all channels in mask, interpolated by the fade slot
+         parameter_ramp(op->ch_mask, op->param, op->target, op->value, op->duration_ms);
+         break;
       default:
          break;
    }
 }
 
 void execute_action_list(uint8_t al_start, uint8_t al_end) {
-   execute_action_list_nested(al_start, al_end, 0);
+   if (al_start >= al_end)
+      return;
+
+   const action_list_t* const list = action_cache_get(al_start, al_end);
+   for (size_t i = 0; i < list->count; i++)
+      execute_op(&list->ops[i]);
+
+   pulse_gen_reschedule(); // Actions might have changed generator state
+}
+
+// Returns the raised sine at the phase (Q16, a full cycle), as a fraction of UINT16_MAX.
+static inline uint16_t lfo_table_lookup(uint32_t phase) {
+   return table_lerp(lfo_table, LFO_FRAC_BITS, phase);
+}
+
+static inline uint16_t lfo_random() {
+   // xorshift32
+   lfo_random_state ^= lfo_random_state << 13;
+   lfo_random_state ^= lfo_random_state >> 17;
+   lfo_random_state ^= lfo_random_state << 5;
+   return lfo_random_state >> 16;
+}
+
+// Sample the LFO waveform at the current phase, as a fraction of UINT16_MAX.
+static inline uint16_t lfo_sample(const parameter_t* p, uint16_t mode, int8_t skew) {
+   const uint32_t phase = p->phase >> 16; // Q16
+
+   if (mode == TARGET_MODE_RANDOM) { // Ease between the random values over the cycle, using the rising half of the raised sine
+      const uint16_t ease = lfo_table_lookup(phase >> 1);
+      return q16_lerp(p->random_from, p->random_to, ease);
+   }
+
+   // Warp the phase so the first half of the waveform takes the skewed fraction of the cycle
+   const uint32_t rise = MIN(MAX(0x8000 + skew * 256, 1), UINT16_MAX);
+   const uint32_t warped = phase < rise ? (phase << 15) / rise : 0x8000 + ((phase - rise) << 15) / (0x10000 - rise);
+
+   switch (mode) {
+      case TARGET_MODE_SINE:
+         return lfo_table_lookup(warped);
+      case TARGET_MODE_TRIANGLE:
+         return MIN(warped < 0x8000 ? warped * 2 : (0x10000 - warped) * 2, UINT16_MAX);
+      case TARGET_MODE_SQUARE:
+         return warped < 0x8000 ? 0 : UINT16_MAX;
+      default:
+         return 0;
+   }
+}
+
+// Advance the LFO phase by the number of updates and set the parameter value from the waveform. Costs the same regardless of waveform or rate.
+// Runs the action list at the start of each cycle.
+static inline void lfo_step(uint8_t ch_index, param_t param, uint16_t mode_raw, uint32_t updates) {
+   parameter_t* p = &generators[ch_index].parameters[param];
+
+   const uint64_t phase = p->phase + (uint64_t)p->phase_inc * updates;
+   const bool wrapped = phase >> 32;
+   p->phase = phase;
+   if (wrapped) {
+      p->random_from = p->random_to;
+      p->random_to = lfo_random();
+   }
+
+   const uint16_t min = parameter_get(ch_index, param, TARGET_MIN);
+   const uint16_t max = parameter_get(ch_index, param, TARGET_MAX);
+   const uint16_t level = lfo_sample(p, mode_raw & TARGET_MODE_MASK, (int8_t)(mode_raw >> TARGET_MODE_SKEW_SHIFT));
+
+   parameter_set(ch_index, param, TARGET_VALUE, max > min ? min + ((uint32_t)(max - min) * level) / UINT16_MAX : min);
+
+   if (wrapped) {
+      // Cycle restarted, run action list if specified
+      const uint16_t al = parameter_get(ch_index, param, TARGET_ACTION_RANGE);
+      execute_action_list(al >> 8, al & 0xff); // start:upper byte, end: lower byte
+   }
 }
 
 // Update the parameter value by stepping based on the current parameter mode and step rate.
-// Handles condition/actions when parameter reaches extent based on mode.
-static inline void parameter_step(uint8_t ch_index, param_t param) {
+// Handles condition/actions when parameter reaches extent based on mode. Lowers deadline to the next step time if sweeping.
+static inline void parameter_step(uint8_t ch_index, param_t param, uint32_t now_us, uint32_t* deadline_us) {
    parameter_t* p = &generators[ch_index].parameters[param];
 
-   // Get the mode without the flag bits
+   // Get the mode without the flag and skew bits
    const uint16_t mode_raw = parameter_get(ch_index, param, TARGET_MODE);
-   const uint16_t mode = mode_raw & ~TARGET_MODE_FLAG;
-
-   // Skip update if parameter is static
-   if (mode == TARGET_MODE_DISABLED || parameter_get(ch_index, param, TARGET_RATE) == 0 || p->step == 0)
-      return;
+   const uint16_t mode = mode_raw & TARGET_MODE_MASK;
 
    // Only update at required time
-   if ((time_us_32() - p->last_update_time_us) < p->update_period_us)
+   if (!deadline_reached(p->next_update_time_us, now_us)) {
+      deadline_min(deadline_us, p->next_update_time_us);
       return;
+   }
+
+   uint32_t steps = 1;
+   if ((now_us - p->next_update_time_us) > SWEEP_MAX_CATCH_UP_US) {
+      p->next_update_time_us = now_us + p->update_period.us; // Resynchronize instead of bursting through the missed steps
+   } else {
+      // Schedule next update from the ideal update time (not the current time), and apply every step period that elapsed since the last update.
+      // So neither loop latency nor periods shorter than the loop slow the sweep down.
+      steps = frac_period_advance(&p->update_period, &p->next_update_time_us, now_us);
+   }
 
-   p->last_update_time_us = time_us_32();
+   deadline_min(deadline_us, p->next_update_time_us);
 
-   // Save current value to check for wrapping
-   const uint16_t previous_value = parameter_get(ch_index, param, TARGET_VALUE);
-   uint16_t value = previous_value + p->step; // Step value
+   if (mode >= TARGET_MODE_SINE) {
+      lfo_step(ch_index, param, mode_raw, steps);
+      return;
+   }
 
    const uint16_t min = parameter_get(ch_index, param, TARGET_MIN);
    const uint16_t max = parameter_get(ch_index, param, TARGET_MAX);
 
-   // Check if value reached min/max or wrapped
-   const bool end_reached = (value <= min) || (value >= max) || (p->step < 0 && value > previous_value) || (p->step > 0 && value < previous_value);
-   if (end_reached) {
-      switch (mode) {
-         case TARGET_MODE_DOWN_UP:
-         case TARGET_MODE_UP_DOWN: { // Invert step direction if UP/DOWN mode
-            value = p->step < 0 ? min : max;
-            p->step *= -1;
-            break;
-         }
-         case TARGET_MODE_UP_RESET: // Reset to MIN if sawtooth mode
-            value = min;
-            break;
-         case TARGET_MODE_DOWN_RESET: // Reset to MAX if reversed sawtooth mode
-            value = max;
-            break;
-         case TARGET_MODE_UP: // Disable cycling for no-reset modes while keeping flag bits
-            value = max;
-            parameter_set(ch_index, param, TARGET_MODE, (mode_raw & TARGET_MODE_FLAG) | TARGET_MODE_DISABLED);
-            break;
-         case TARGET_MODE_DOWN: // Disable cycling for no-reset modes while keeping flag bits
-            value = min;
-            parameter_set(ch_index, param, TARGET_MODE, (mode_raw & TARGET_MODE_FLAG) | TARGET_MODE_DISABLED);
-            break;
-         default:
-            return;
-      }
-   }
+   uint16_t value = parameter_get(ch_index, param, TARGET_VALUE);
+   const bool end_reached = sweep_advance(&value, &p->step, steps, min, max, mode) != 0;
+
+   if (end_reached && (mode == TARGET_MODE_UP || mode == TARGET_MODE_DOWN)) // Disable cycling for no-reset modes while keeping flag and skew bits
+      parameter_set(ch_index, param, TARGET_MODE, (mode_raw & ~TARGET_MODE_MASK) | TARGET_MODE_DISABLED);
 
    parameter_set(ch_index, param, TARGET_VALUE, value); // Update value
 
    if (end_reached) {
-      // Parameter value extent reached, run action list if specified
+      // Parameter value extent reached (once or more since the last update), run action list if specified
       const uint16_t al = parameter_get(ch_index, param, TARGET_ACTION_RANGE);
       execute_action_list(al >> 8, al & 0xff); // start:upper byte, end: lower byte
    }
 }
 
+// Update the channel sweep mask bit for the parameter. Parameter is sweeping if it has a mode, a rate, and a non-zero step.
+static inline void sweep_mask_update(uint8_t ch_index, param_t param) {
+   generator_t* const gen = &generators[ch_index];
+
+   const uint16_t mode = parameter_get(ch_index, param, TARGET_MODE) & TARGET_MODE_MASK;
+   const bool sweeping = mode != TARGET_MODE_DISABLED && parameter_get(ch_index, param, TARGET_RATE) != 0 && gen->parameters[param].step != 0;
+
+   if (sweeping) {
+      gen->sweep_mask |= (1 << param);
+   } else {
+      gen->sweep_mask &= ~(1 << param);
+   }
+}
+
+void parameter_set(uint8_t ch_index, param_t param, target_t target, uint16_t value) {
+   pulse_gen->channels[ch_index].parameters[param][target] = value;
+
+   switch (target) {
+      case TARGET_VALUE:
+         if (DERIVED_PARAM_BITS[param]) // Keep the derived values current, so reading them needs no staleness check
+            derived_set(&generators[ch_index].derived, __builtin_ctz(DERIVED_PARAM_BITS[param]), value, pulse_gen->channels[ch_index].frequency_frac,
+                        MAX_FREQ_Q8);
+         break;
+      case TARGET_MODE:
+      case TARGET_RATE: // Stop stepping immediately if disabled
+         sweep_mask_update(ch_index, param);
+         // fall through
+      case TARGET_MIN:
+      case TARGET_MAX: // Step and update period are recomputed lazily
+         generators[ch_index].stale_mask |= (1 << param);
+         break;
+      default:
+         break;
+   }
+}
+
+void config_parameter_set(uint8_t ch_index, param_t param, target_t target, uint16_t value) {
+   if (config_staging) { // Generator state is refreshed on commit
+      pulse_gen_shadow->channels[ch_index].parameters[param][target] = value;
+      config_written.parameters[ch_index][param] |= (1 << target);
+   } else {
+      fade_cancel(ch_index, param, target); // Direct writes take over from a running ramp
+      parameter_set(ch_index, param, target, value);
+   }
+}
+
+void config_en_mask_set(ch_mask_t en_mask) {
+   pulse_gen_t* const cfg = pulse_gen_config();
+
+   if (config_staging)
+      config_written.en_mask |= cfg->en_mask ^ en_mask;
+   cfg->en_mask = en_mask;
+}
+
+void config_sequencer_index_set(uint8_t index) {
+   if (config_staging)
+      config_written.sequencer_index = true;
+   pulse_gen_config()->sequencer.index = index;
+}
+
 void parameter_update(uint8_t ch_index, param_t param) {
    if (ch_index >= CHANNEL_COUNT || param >= TOTAL_PARAMS)
       return;
 
-   // Get the mode without flag bits
-   const uint16_t mode = parameter_get(ch_index, param, TARGET_MODE) & ~TARGET_MODE_FLAG;
+   generator_t* const gen = &generators[ch_index];
+   gen->stale_mask &= ~(1 << param);
+
+   // Get the mode without flag and skew bits
+   const uint16_t mode = parameter_get(ch_index, param, TARGET_MODE) & TARGET_MODE_MASK;
 
    // Determine steps and update period based on cycle rate
    const uint16_t rate = parameter_get(ch_index, param, TARGET_RATE);
    if (mode != TARGET_MODE_DISABLED && rate != 0) {
-      parameter_t* p = &generators[ch_index].parameters[param];
-
-      const int8_t previous_step = p->step;
+      parameter_t* p = &gen->parameters[param];
 
-      p->step = 1; // Start at 1 step for highest resolution
+      // A running UP_DOWN/DOWN_UP sweep keeps its direction when recomputed, since targets are recomputed lazily after every write
+      const int8_t previous_step = p->mode == mode ? p->step : 0;
+      p->mode = mode;
 
       const uint16_t min = parameter_get(ch_index, param, TARGET_MIN);
       const uint16_t max = parameter_get(ch_index, param, TARGET_MAX);
-      while (p->step < 100) {
-         uint32_t delta = (max - min) / p->step;
 
-         if (delta == 0) { // If value range is zero, soft disable stepping
-            p->step = 0;
-            break;
+      if (max <= min) { // If value range is zero, soft disable stepping
+         p->step = 0;
+      } else if (mode >= TARGET_MODE_SINE) {
+         // LFO is evaluated at a fixed period, advancing the cycle phase by rate (mHz) * period each update
+         p->step = 1; // Unused, but marks the parameter as sweeping
+         p->phase_inc = (((uint64_t)rate << 32) * LFO_UPDATE_PERIOD_US + 500000000u) / 1000000000u;
+         frac_period_set(&p->update_period, LFO_UPDATE_PERIOD_US, 1);
+
+         // Start the cycle from now if not already sweeping, otherwise keep the existing phase
+         if (~gen->sweep_mask & (1 << param)) {
+            p->next_update_time_us = time_us_32() + p->update_period.us;
+            p->phase = 0;
+            p->random_from = 0;
+            p->random_to = lfo_random();
          }
+      } else {
+         p->step = sweep_period_set(&p->update_period, rate, max - min);
 
-         // Number of microseconds it takes to go from one extent to another
-         // rate is currently in millihertz, making the max rate be ~65 Hz
-         uint32_t period = 1000000000 / rate;
-
-         if (period >= delta) {                   // Delay is 1us or greater
-            p->update_period_us = period / delta; // Number of microseconds between each value
-            break;
-         } else {
-            p->step++; // Increase step so update period will be 1us or more
-         }
+         // Start timing from now if not already sweeping, otherwise keep the existing schedule
+         if (~gen->sweep_mask & (1 << param))
+            p->next_update_time_us = time_us_32() + p->update_period.us;
       }
 
-      // Invert step direction if MODE_DOWN or out of sync
-      if (mode == TARGET_MODE_DOWN_RESET || mode == TARGET_MODE_DOWN || (mode == TARGET_MODE_DOWN_UP && previous_step > 0) ||
-          (mode == TARGET_MODE_UP_DOWN && previous_step < 0))
+      // Invert step direction if MODE_DOWN, or if an UP_DOWN/DOWN_UP sweep was decrementing. Starting from rest, DOWN_UP decrements first.
+      if ((mode == TARGET_MODE_UP_DOWN || mode == TARGET_MODE_DOWN_UP) && previous_step != 0) {
+         if (previous_step < 0)
+            p->step = -(p->step);
+      } else if (mode == TARGET_MODE_DOWN_RESET || mode == TARGET_MODE_DOWN || mode == TARGET_MODE_DOWN_UP) {
          p->step = -(p->step);
+      }
    }
+
+   sweep_mask_update(ch_index, param);
 }
\ No newline at end of file
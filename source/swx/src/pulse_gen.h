@@ -21,33 +21,82 @@
 #include "swx.h"
 #include "parameter.h"
 #include "channel.h"
+#include "preview.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define TIMER_WHEEL_CAPACITY (32)    // Maximum number of pending deferred actions
+#define MAX_GROUPS (CHANNEL_COUNT)   // Maximum number of phase locked channel groups
+#define MAX_LOOKAHEAD_US (20000)     // Longest pulse lookahead horizon
+#define MOD_UPDATE_PERIOD_US (1000)  // Modulation matrix evaluation period
+#define MAX_SCENE_OPS (256)          // Maximum number of per-channel scene values in a compiled timeline
+#define MAX_FADES (32)               // Maximum number of parameter fades running at once
+#define FADE_UPDATE_PERIOD_US (1000) // Parameter fade evaluation period
+#define MORPH_BANKS (2)              // Number of morph parameter banks (A and B)
+
 typedef struct {
    bool enabled; // True if action is enabled (type must not be ACTION_NONE).
 
    action_type_t type; // The operation to perform when this action runs. Set ACTION_NONE to disable.
-   uint8_t ch_mask;    // Channel mask indicating channels this action will affect (LSB=channel 1).
+   ch_mask_t ch_mask;  // Channel mask indicating channels this action will affect (LSB=channel 1).
 
    param_t param;   // A parameter used as an argument by some operations.
    target_t target; // A target used as an argument by some operations.
 
-   uint16_t value; // A main value used by operations (e.g. increment/decrement amount).
+   uint16_t value;       // A main value used by operations (e.g. increment/decrement amount).
+   uint16_t duration_ms; // Ramp duration used by ACTION_RAMP_TO.
 } action_t;
 
+// Drives a parameter target from a live source. Routes are compiled into a flat list, evaluated every MOD_UPDATE_PERIOD_US.
+// Each route contributes offset + (level * depth), routes with the same destination are summed, then limited to 0 to UINT16_MAX.
+// For TARGET_VALUE the sum is a fraction of the destination parameter min to max range, otherwise it is the target value.
+typedef struct {
+   mod_source_t source;  // Where the level is read from. Set MOD_SOURCE_NONE to disable.
+   uint8_t source_index; // Source channel, analog channel, or trigger input bit depending on source. See mod_source_t.
+   param_t source_param; // The source parameter for MOD_SOURCE_PARAMETER.
+
+   ch_mask_t ch_mask; // Destination channels (LSB=channel 1).
+   param_t param;     // Destination parameter.
+   target_t target;   // Destination target.
+
+   uint16_t offset; // Fraction of UINT16_MAX, added to the modulation.
+   int16_t depth;   // Signed fraction of INT16_MAX the source level is scaled by.
+} mod_route_t;
+
+// A parameter target value set by a timeline step.
+typedef struct {
+   ch_mask_t ch_mask; // Channels the value is set on (LSB=channel 1).
+   uint8_t param;     // See param_t.
+   uint8_t target;    // See target_t.
+   uint16_t value;
+} scene_entry_t;
+
+// A timeline step. Steps run in order for their duration, wrapping back to the first step after the last.
+// When a step starts, the channel enable mask is replaced with its mask and its scene values are set.
+typedef struct {
+   uint16_t duration_ms; // How long the step runs. Steps with zero duration are skipped.
+   uint16_t fade_ms;     // Crossfade into the next step scene, taken from the end of this step (limited to the duration). Zero switches instantly.
+   ch_mask_t en_mask;    // Channels enabled during the step (LSB=channel 1), masked with pulse_gen_t.en_mask.
+   uint8_t scene_start;  // Index of the first scene entry of the step.
+   uint8_t scene_count;  // Number of scene entries of the step, zero for none.
+} timeline_step_t;
+
 typedef struct {
    // A bitflag mask indicating what pulse generator channel is enabled (LSB=channel 1).
    // This mask is also updated by actions (e.g. ACTION_ENABLE/DISABLE) to control generation.
-   uint8_t en_mask;
+   ch_mask_t en_mask;
+
+   // How far ahead pulses are queued for output (microseconds, limited to MAX_LOOKAHEAD_US). Set zero to queue each pulse when due.
+   // Queued pulses are output even while the main loop is stalled, and are replanned when the pulse shape or frequency changes.
+   uint16_t lookahead_us;
 
    struct {
-      uint32_t period_us;           // The duration between sequence mask changes. Set zero to disable sequencer.
-      uint8_t index;                // The current mask index.
-      uint8_t count;                // The number of sequence items in the masks array before wrapping. Set zero to disable sequencer.
-      uint8_t masks[MAX_SEQUENCES]; // LSB=channel 1
+      uint32_t period_us;             // The duration between sequence mask changes. Set zero to disable sequencer.
+      uint8_t index;                  // The current mask index.
+      uint8_t count;                  // The number of sequence items in the masks array before wrapping. Set zero to disable sequencer.
+      ch_mask_t masks[MAX_SEQUENCES]; // LSB=channel 1
    } sequencer;
 
    struct {
@@ -55,35 +104,174 @@ typedef struct {
       // MSBs contains flags indicating how the source should be processed. See AUDIO_MODE_FLAG*.
       uint8_t audio;
 
+      // The envelope shape used when ramping power during PARAM_ON_RAMP_TIME and PARAM_OFF_RAMP_TIME. See ramp_curve_t.
+      uint8_t ramp_curve;
+
+      // Phase locked group (1 to MAX_GROUPS), set zero for none. Members pulse from a shared timebase at the frequency of the lowest index member.
+      uint8_t group;
+
+      // Pulse phase offset relative to the group timebase, as a fraction of the period (UINT16_MAX = 360 degrees).
+      uint16_t phase;
+
+      // Fractional part of PARAM_FREQUENCY in 1/256 dHz units, added to the parameter value.
+      uint8_t frequency_frac;
+
+      // How output power is applied to the channel. See power_mode_t.
+      uint8_t power_mode;
+
+      // Width power table used by POWER_MODE_WIDTH. Pulse width multiplier (fraction of UINT16_MAX) at evenly spaced power levels, linearly interpolated.
+      // Calibrated per channel so perceived intensity follows power, defaults to linear.
+      uint16_t power_lut[POWER_LUT_SIZE + 1];
+
+      // The shape of each generated pulse. Pulse width (PARAM_PULSE_WIDTH) is the positive phase width.
+      struct {
+         uint8_t flags;            // See WAVEFORM_FLAG*
+         uint16_t neg_width_us;    // The negative phase width. Set zero to use the pulse width (symmetric).
+         uint8_t gap_us;           // The inter-phase gap between the positive and negative phases.
+         uint8_t burst_count;      // The number of pulses generated for each pulse period. Zero or one for single pulses.
+         uint16_t burst_period_us; // The period between the start of each pulse in a burst.
+      } waveform;
+
       uint16_t parameters[TOTAL_PARAMS][TOTAL_TARGETS];
    } channels[CHANNEL_COUNT];
 
    // A list of actions, a range of actions can be run by using the execute_action_list() function.
    action_t actions[MAX_ACTIONS];
+
+   // Modulation matrix, see mod_route_t.
+   mod_route_t mod_routes[MAX_MOD_ROUTES];
+
+   // Timeline mode, replaces the sequencer while enabled. Compiled into a flat list of steps and per-channel scene values.
+   struct {
+      uint8_t count;                             // The number of steps before wrapping. Set zero to disable the timeline.
+      timeline_step_t steps[MAX_TIMELINE_STEPS]; // See timeline_step_t.
+      scene_entry_t scenes[MAX_SCENE_ENTRIES];   // Scene entries, shared by steps. See scene_entry_t.
+   } timeline;
+
+   // Morph mode, channel parameters are interpolated between two banks by the position. Bank values are compiled into per-target deltas.
+   // Only targets set (or captured) in both banks follow the morph, the others keep their value.
+   struct {
+      bool enabled;      // True if channel parameters follow the banks.
+      uint16_t position; // Fraction of UINT16_MAX, zero is bank A, UINT16_MAX is bank B. TARGET_MODE and TARGET_ACTION_RANGE switch at the midpoint.
+      uint16_t banks[MORPH_BANKS][CHANNEL_COUNT][TOTAL_PARAMS][TOTAL_TARGETS];
+      uint8_t captured[MORPH_BANKS][CHANNEL_COUNT][TOTAL_PARAMS]; // Bitmask of bank targets that have been set (LSB=target 0).
+   } morph;
 } pulse_gen_t;
 
-extern pulse_gen_t pulse_gen;
+typedef struct {
+   uint8_t capacity;       // Maximum number of pending deferred actions (TIMER_WHEEL_CAPACITY).
+   uint8_t occupancy;      // Number of pending deferred actions.
+   uint8_t peak_occupancy; // Highest occupancy since the stats were reset.
+   uint32_t overflows;     // Number of deferred actions dropped because the wheel was full.
+   uint32_t expired;       // Number of deferred actions run.
+   uint32_t max_late_us;   // Longest delay between when a deferred action was due and when it ran.
+} timer_wheel_stats_t;
+
+typedef struct {
+   uint32_t freq_q8;          // Configured pulse frequency (dHz, Q8), after limiting.
+   uint32_t measured_freq_q8; // Measured pulse frequency over the last measurement window (dHz, Q8).
+   int32_t error_ppm;         // Measured rate error relative to the configured frequency, in parts per million.
+   uint32_t resyncs;          // Number of times pulse timing fell more than a period behind and restarted.
+} rate_stats_t;
+
+// The live configuration used by the generator. Swapped with the staged configuration on commit, so don't cache the pointer.
+extern pulse_gen_t* pulse_gen;
 
 void pulse_gen_init();
 
 // Update pulse generator by updating sequencer, parameters, power level transitions, and generating the actual
 // pulses manually or via audio processing depending on configured source.
+// Work is deadline driven, returns immediately unless a deadline has been reached (or rescheduled).
 void pulse_gen_process();
 
+// Forces every channel and the sequencer to be re-evaluated on the next pulse_gen_process() call.
+// Should be called whenever pulse_gen is changed externally (e.g. protocol, actions). Safe to call from IRQ context.
+void pulse_gen_reschedule();
+
+// Starts staging configuration writes in a shadow copy of the live configuration. See pulse_gen_config().
+// Starting again while already staging discards the staged writes.
+void pulse_gen_begin();
+
+// Stops staging and makes the staged configuration live at the start of the next pulse_gen_process() pass.
+// Runtime changes made while staging (e.g. sweeping parameter values, enable mask changes by actions, the sequencer index) are kept,
+// unless the same field was written while staging.
+void pulse_gen_commit();
+
+// Stops staging and discards the staged configuration.
+void pulse_gen_abort();
+
+// Returns true if configuration writes are being staged.
+bool pulse_gen_staging();
+
+// Returns the configuration that external writes (e.g. protocol) should modify, the staged copy while staging, otherwise the live configuration.
+pulse_gen_t* pulse_gen_config();
+
+// Sets a parameter target in the configuration returned by pulse_gen_config(). Same as parameter_set() when not staging.
+void config_parameter_set(uint8_t ch_index, param_t param, target_t target, uint16_t value);
+
+// Sets the channel enable mask in the configuration returned by pulse_gen_config().
+void config_en_mask_set(ch_mask_t en_mask);
+
+// Sets the sequencer index in the configuration returned by pulse_gen_config().
+void config_sequencer_index_set(uint8_t index);
+
 // Updates the parameter step period and step size based on the current target mode, minmum, maximum, and rate.
-// Should be called whenever TARGET_MODE, TARGET_MIN, TARGET_MAX, or TARGET_RATE is changed, and the parameter is
-// sweeping the value.
+// Done automatically before the next step whenever parameter_set() changes TARGET_MODE, TARGET_MIN, TARGET_MAX, or TARGET_RATE.
+// Calling this directly forces the update to occur immediately.
 void parameter_update(uint8_t ch_index, param_t param);
 
-// Execute each action between indices al_start and al_end
+// Execute each action between indices al_start and al_end. Ranges are compiled into flat lists on first use and cached.
 void execute_action_list(uint8_t al_start, uint8_t al_end);
 
-static inline void parameter_set(uint8_t ch_index, param_t param, target_t target, uint16_t value) {
-   pulse_gen.channels[ch_index].parameters[param][target] = value;
-}
+// Returns the configured and measured pulse rate of a channel.
+void pulse_gen_rate(uint8_t ch_index, rate_stats_t* stats);
+
+// Snapshots the configuration and generator state of a channel, for fast-forwarding with preview_run().
+void pulse_gen_preview(uint8_t ch_index, preview_channel_t* preview);
+
+// Returns the deferred action timer wheel counters (delayed ACTION_ENABLE/DISABLE/TOGGLE).
+const timer_wheel_stats_t* timer_wheel_stats();
+
+// Resets the timer wheel counters. Peak occupancy is reset to the current occupancy.
+void timer_wheel_stats_reset();
+
+// Sets the action at the given action slot index in the configuration returned by pulse_gen_config(), and recompiles cached action lists.
+// Returns false (leaving the slot unchanged) if the action would create an ACTION_EXECUTE cycle or nest too deep.
+bool action_set(uint8_t a_index, const action_t* action);
+
+// Sets the modulation route at the given index in the configuration returned by pulse_gen_config(), and recompiles the routing list.
+// Returns false (leaving the route unchanged) if the source or destination is out of range.
+bool mod_route_set(uint8_t r_index, const mod_route_t* route);
+
+// Sets the timeline step at the given index in the configuration returned by pulse_gen_config(), and recompiles the timeline.
+// Returns false (leaving the step unchanged) if the scene range is out of range.
+bool timeline_step_set(uint8_t s_index, const timeline_step_t* step);
+
+// Sets the scene entry at the given index in the configuration returned by pulse_gen_config(), and recompiles the timeline.
+// Returns false (leaving the entry unchanged) if the parameter or target is out of range.
+bool scene_entry_set(uint8_t e_index, const scene_entry_t* entry);
+
+// Sets the number of timeline steps in the configuration returned by pulse_gen_config(), and recompiles the timeline. Zero disables the timeline.
+void timeline_count_set(uint8_t count);
+
+// Linearly ramps a parameter target on each channel in the mask to the value over the duration, replacing any running ramp of the same target.
+// TARGET_VALUE is limited between TARGET_MIN and TARGET_MAX. A zero duration sets the value immediately.
+void parameter_ramp(ch_mask_t ch_mask, param_t param, target_t target, uint16_t value, uint16_t duration_ms);
+
+// Sets a morph bank parameter target in the configuration returned by pulse_gen_config(), marking it captured, and recompiles the morph.
+void morph_bank_set(uint8_t bank, uint8_t ch_index, param_t param, target_t target, uint16_t value);
+
+// Copies the parameters of every channel in the configuration returned by pulse_gen_config() into the morph bank, and recompiles the morph.
+void morph_bank_capture(uint8_t bank);
+
+// Sets the morph state in the configuration returned by pulse_gen_config(). Channel parameters are updated immediately when not staging.
+void morph_set(bool enabled, uint16_t position);
+
+// Sets a parameter target value. Keeps the generator sweep state in sync when TARGET_MODE or TARGET_RATE changes.
+void parameter_set(uint8_t ch_index, param_t param, target_t target, uint16_t value);
 
 static inline uint16_t parameter_get(uint8_t ch_index, param_t param, target_t target) {
-   return pulse_gen.channels[ch_index].parameters[param][target];
+   return pulse_gen->channels[ch_index].parameters[param][target];
 }
 
 #ifdef __cplusplus
@@ -26,6 +26,7 @@
 #include "version.h"
 
 #include "util/gpio.h"
+#include "util/pulse_math.h"
 
 // Write debugging information to stdout. Includes trailing zero byte to reset receiver line buffer for COBS framing.
 #define LOG_WRITE(lvl, fmt, ...)                                                                                                                                         \
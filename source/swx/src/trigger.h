@@ -33,7 +33,7 @@ typedef struct {
    uint8_t input_invert_mask; // Bitmask inversion for specific trigger channels (LSB=trigger A1).
 
    analog_channel_t input_audio; // Audio source to compare volume against set threshold. Set ANALOG_CHANNEL_NONE to disable threshold detection.
-   float threshold;
+   uint16_t threshold; // Audio amplitude threshold, as a fraction of UINT16_MAX.
    bool threshold_invert; // True to invert threshold result - ie. true when below threshold.
    bool require_both;     // True, trigger will activate only when input operation and threshold are both true, else activate when either are true.
 
@@ -0,0 +1,335 @@
+/*
+ * swx
+ * Copyright (C) 2024 saawsm
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _PULSE_MATH_H
+#define _PULSE_MATH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "parameter.h"
+
+// Fixed-point math and timing shared by the pulse generator and the preview. Pure functions of their arguments, and only depends on the
+// C standard library and public headers, so the preview (and tests) can be built on the host.
+
+#define STATE_COUNT (4) // Number of "waveform" states (on_ramp, on, off_ramp, off)
+
+#define RAMP_FRAC_BITS (16 - RAMP_TABLE_BITS)     // Phase bits used for interpolating between ramp table entries
+#define POWER_LUT_FRAC_BITS (16 - POWER_LUT_BITS) // Power bits used for interpolating between width power table entries
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Numerically controlled oscillator, events are scheduled from the previous ideal event time so loop latency doesn't accumulate.
+// The period has a 32-bit fractional part, so fractional frequencies don't drift either.
+typedef struct {
+   uint32_t next_time_us; // The ideal absolute timestamp of the next event.
+   uint32_t period_us;    // Whole microseconds per event.
+   uint32_t period_frac;  // Fractional microseconds per event (Q32).
+   uint32_t period_acc;   // Accumulated fractional microseconds (Q32), carries into next_time_us on overflow.
+   uint32_t resyncs;      // Number of times the oscillator fell more than a period behind and restarted from the current time.
+   bool restart;          // True if the next event should occur immediately, restarting the timebase from the current time.
+} nco_t;
+
+// A period of us + (rem / den) microseconds. The fractional part is accumulated (Bresenham style), so the average period is exact over long runs.
+typedef struct {
+   uint32_t us;
+   uint32_t rem;
+   uint32_t den;
+   uint32_t acc;
+} frac_period_t;
+
+#define DERIVED_FREQ (STATE_COUNT)                  // Derived value bit of freq_q8, the bits below are the state times
+#define DERIVED_ALL ((1 << (DERIVED_FREQ + 1)) - 1) // Every derived value bit
+
+// Values derived from channel parameters, each set when a parameter it depends on is written. See derived_set().
+typedef struct {
+   uint8_t frequency_frac;              // The frequency_frac freq_q8 was computed with, it is written directly (not as a parameter).
+   uint32_t freq_q8;                    // Pulse frequency (dHz, Q8), including the fractional part and limited to the max frequency.
+   uint32_t state_time_us[STATE_COUNT]; // Duration of each "waveform" state.
+} derived_t;
+
+// Multiply two unsigned Q16 fractions (UINT16_MAX representing 1.0). Rounds so that UINT16_MAX * UINT16_MAX = UINT16_MAX.
+static inline uint16_t q16_mul(uint16_t a, uint16_t b) {
+   return ((uint32_t)a * b + UINT16_MAX) >> 16;
+}
+
+// Interpolate from a to b by the fraction t (Q16, 1 << 16 is b). Q15 keeps the product in 32 bits.
+static inline uint16_t q16_lerp(uint16_t a, uint16_t b, uint32_t t) {
+   return a + ((((int32_t)b - a) * (int32_t)(t >> 1)) >> 15);
+}
+
+// Linear interpolation between the two nearest table entries. The table has (1 << (16 - frac_bits)) + 1 entries.
+static inline uint16_t table_lerp(const uint16_t* table, uint8_t frac_bits, uint16_t x) {
+   const uint16_t* const entry = &table[x >> frac_bits];
+   const uint32_t frac = x & ((1 << frac_bits) - 1);
+
+   return entry[0] + ((((int32_t)entry[1] - entry[0]) * (int32_t)frac) >> frac_bits);
+}
+
+// Returns true if the given deadline is at or before the timestamp. Handles 32-bit timer wrapping.
+static inline bool deadline_reached(uint32_t deadline_us, uint32_t now_us) {
+   return (int32_t)(now_us - deadline_us) >= 0;
+}
+
+// Lower the deadline to the given timestamp, if the timestamp is sooner.
+static inline void deadline_min(uint32_t* deadline_us, uint32_t time_us) {
+   if ((int32_t)(time_us - *deadline_us) < 0)
+      *deadline_us = time_us;
+}
+
+// Returns the phase increment per microsecond (Q16 phase, scaled by 2^16) of something lasting the duration (more than 1us).
+// Rounded up so it completes on time.
+static inline uint32_t phase_inc_us(uint32_t duration_us) {
+   return ((1ull << 32) + duration_us - 1) / duration_us;
+}
+
+// Returns the phase (Q16, 1 << 16 is complete) after the elapsed time. Not limited, so phases past the end are larger than 1 << 16.
+static inline uint32_t phase_elapsed(uint32_t elapsed_us, uint32_t phase_inc) {
+   return ((uint64_t)elapsed_us * phase_inc) >> 16;
+}
+
+// Returns the ramp power modifier (fraction of UINT16_MAX) from the ramp envelope table, for the time elapsed since the ramp started.
+// The envelope is played backwards for the off ramp.
+static inline uint16_t ramp_envelope(const uint16_t* ramp_table, uint32_t phase_inc, bool off_ramp, uint32_t elapsed_us) {
+   uint32_t phase = phase_elapsed(elapsed_us, phase_inc);
+   if (phase > UINT16_MAX)
+      phase = UINT16_MAX;
+
+   if (off_ramp)
+      phase = UINT16_MAX - phase;
+
+   return table_lerp(ramp_table, RAMP_FRAC_BITS, phase);
+}
+
+// Scale the pulse width by the width power table for the power, relative to the power ceiling the DAC is held at. See POWER_MODE_WIDTH.
+static inline uint16_t width_power_scale(const uint16_t* power_lut, uint16_t pulse_width, uint16_t power, uint16_t power_max) {
+   const uint32_t level = power_max ? ((uint32_t)power * UINT16_MAX) / power_max : 0;
+
+   return q16_mul(pulse_width, table_lerp(power_lut, POWER_LUT_FRAC_BITS, level > UINT16_MAX ? UINT16_MAX : level));
+}
+
+// Returns the pulse frequency (dHz, Q8) including the fractional part, limited to max_freq_q8. Zero if pulses are disabled.
+static inline uint32_t freq_q8_limit(uint16_t frequency, uint8_t frequency_frac, uint32_t max_freq_q8) {
+   if (frequency == 0)
+      return 0;
+
+   const uint32_t freq_q8 = ((uint32_t)frequency << 8) + frequency_frac;
+   return freq_q8 < max_freq_q8 ? freq_q8 : max_freq_q8;
+}
+
+// Set the derived value of the bit (state index, or DERIVED_FREQ) from the value of the parameter it depends on.
+static inline void derived_set(derived_t* derived, uint8_t bit, uint16_t value, uint8_t frequency_frac, uint32_t max_freq_q8) {
+   if (bit == DERIVED_FREQ) {
+      derived->frequency_frac = frequency_frac;
+      derived->freq_q8 = freq_q8_limit(value, frequency_frac, max_freq_q8);
+   } else {
+      derived->state_time_us[bit] = value * 1000u;
+   }
+}
+
+// Recompute the derived values in the mask (LSB=state 0, see DERIVED_FREQ) from the channel parameters.
+// state_params are the parameters holding each state duration (ms).
+static inline void derived_update(derived_t* derived, uint8_t mask, const uint16_t parameters[TOTAL_PARAMS][TOTAL_TARGETS],
+                                  const param_t state_params[STATE_COUNT], uint8_t frequency_frac, uint32_t max_freq_q8) {
+   for (; mask; mask &= mask - 1) {
+      const uint8_t bit = __builtin_ctz(mask);
+      const param_t param = bit == DERIVED_FREQ ? PARAM_FREQUENCY : state_params[bit];
+
+      derived_set(derived, bit, parameters[param][TARGET_VALUE], frequency_frac, max_freq_q8);
+   }
+}
+
+// Advance the "waveform" state to the one running at the timestamp, states with zero duration are skipped.
+// Next state starts when the previous one ideally ended, restart from now if more than a state behind (e.g. state times changed).
+// Skipped states don't restart, otherwise any loop latency would shift the timebase. Returns false if every state has zero duration, so the state is held.
+static inline bool state_advance(const uint32_t state_time_us[STATE_COUNT], uint8_t* state_index, uint32_t* state_start_us, uint32_t now_us) {
+   for (uint8_t i = 0; i < STATE_COUNT; i++) {
+      const uint32_t state_time = state_time_us[*state_index];
+      if (state_time != 0 && (now_us - *state_start_us) < state_time)
+         return true;
+
+      *state_start_us += state_time;
+      if (state_time != 0 && (now_us - *state_start_us) > state_time)
+         *state_start_us = now_us;
+
+      if (++*state_index >= STATE_COUNT)
+         *state_index = 0; // Increment or reset after 4 states (on_ramp, on, off_ramp, off)
+   }
+   return false;
+}
+
+// Set the period to num / den microseconds, restarting the accumulated fraction.
+static inline void frac_period_set(frac_period_t* period, uint64_t num, uint32_t den) {
+   period->us = num / den;
+   period->rem = num % den;
+   period->den = den;
+   period->acc = 0;
+}
+
+// Returns the length of the next period in whole microseconds, carrying a microsecond whenever the accumulated fractions add up to one.
+static inline uint32_t frac_period_next(frac_period_t* period) {
+   if (period->acc >= period->den - period->rem) {
+      period->acc -= period->den - period->rem;
+      return period->us + 1;
+   }
+
+   period->acc += period->rem;
+   return period->us;
+}
+
+// Advance the time (which must be reached) by whole periods until it is after the timestamp, returns the number of periods that elapsed.
+// The common case of a single period is cheap, more periods (e.g. the period is shorter than the loop) are counted without iterating.
+static inline uint32_t frac_period_advance(frac_period_t* period, uint32_t* time_us, uint32_t now_us) {
+   *time_us += frac_period_next(period);
+   if (!deadline_reached(*time_us, now_us))
+      return 1;
+
+   // The time after n more periods is floor((n * num + acc) / den), so the count of periods starting at or before now is
+   // ceil(((now - time + 1) * den - acc) / num). Fits in 64 bits, since the time is less than 2^31 us behind.
+   const uint64_t num = (uint64_t)period->us * period->den + period->rem;
+   const uint64_t n = ((uint64_t)(now_us - *time_us + 1) * period->den - period->acc + num - 1) / num;
+   const uint64_t total = n * num + period->acc;
+
+   *time_us += total / period->den;
+   period->acc = total % period->den;
+   return n + 1;
+}
+
+// Step a sweeping value by steps * step between min and max. At the extents UP_DOWN/DOWN_UP bounce back (inverting the step), UP_RESET/DOWN_RESET
+// restart from the other extent, and other modes (e.g. UP/DOWN) stop. Steps past an extent carry over, so applying several steps at once keeps
+// the sweep rate exact. Values outside the range start from the nearest extent. Returns the number of times an extent was reached.
+static inline uint32_t sweep_advance(uint16_t* value, int8_t* step, uint32_t steps, uint16_t min, uint16_t max, uint8_t mode) {
+   if (max <= min) {
+      *value = min;
+      return 0;
+   }
+
+   const uint32_t range = max - min;
+   const uint32_t x = *value < min ? 0 : (*value > max ? range : (uint32_t)(*value - min)); // Position within the range
+   const uint64_t travel = (uint64_t)steps * (*step < 0 ? -*step : *step);
+
+   switch (mode) {
+      case TARGET_MODE_UP_DOWN:
+      case TARGET_MODE_DOWN_UP: {
+         // Unfold the bounce into a cycle of twice the range, rising for the first half
+         const uint64_t from = *step < 0 ? 2 * range - x : x;
+         const uint64_t to = from + travel;
+         const uint32_t phase = to % (2 * range);
+
+         const bool rising = phase < range;
+         if (rising != (*step > 0))
+            *step = -*step;
+
+         *value = min + (rising ? phase : 2 * range - phase);
+         return to / range - from / range;
+      }
+      case TARGET_MODE_UP_RESET:
+      case TARGET_MODE_DOWN_RESET: {
+         // Distance from the extent the sweep restarts at, reaching the other extent restarts it
+         const uint32_t from = (mode == TARGET_MODE_UP_RESET ? x : range - x) % range;
+         const uint64_t to = from + travel;
+
+         *value = mode == TARGET_MODE_UP_RESET ? min + to % range : max - to % range;
+         return to / range;
+      }
+      default: {
+         const int64_t to = *step < 0 ? (int64_t)x - (int64_t)travel : (int64_t)x + (int64_t)travel;
+         if (to <= 0 || to >= range) {
+            *value = to <= 0 ? min : max;
+            return 1;
+         }
+
+         *value = min + to;
+         return 0;
+      }
+   }
+}
+
+// Set the sweep step period for going across the range at the rate (mHz), returns the number of values stepped per period.
+// Going from one extent to another takes 1e9 / rate microseconds (rate is in millihertz, making the max rate be ~65 Hz).
+// So each value takes 1e9 / (rate * range) microseconds, step multiple values at a time if that is less than 1us.
+static inline uint32_t sweep_period_set(frac_period_t* period, uint16_t rate, uint16_t range) {
+   const uint32_t den = rate * (uint32_t)range; // Fits since both are 16-bit
+   const uint32_t step = ((den - 1) / 1000000000u) + 1;
+
+   frac_period_set(period, step * 1000000000ull, den);
+   return step;
+}
+
+// Set the oscillator period from a Q32 microsecond period. The next event stays relative to the previous one, so period changes are phase continuous.
+static inline void nco_set_period(nco_t* nco, uint64_t period_q32) {
+   const uint32_t period_us = period_q32 >> 32;
+
+   nco->next_time_us += period_us - nco->period_us; // Reschedule from the previous ideal event time
+   nco->period_us = period_us;
+   nco->period_frac = (uint32_t)period_q32;
+}
+
+// Returns true if the next event is at or before the horizon, restarting from the current time if it fell more than a period behind (e.g. after being idle),
+// instead of bursting events to catch up. A horizon after the current time lets events be planned ahead.
+static inline bool nco_due_before(nco_t* nco, uint32_t now_us, uint32_t horizon_us) {
+   if (nco->restart) {
+      nco->restart = false;
+      nco->next_time_us = now_us;
+      nco->period_acc = 0;
+      return true;
+   }
+
+   if (!deadline_reached(nco->next_time_us, horizon_us))
+      return false;
+
+   if (!deadline_reached(nco->next_time_us, now_us))
+      return true; // Ahead of time, so can't be behind
+
+   if ((now_us - nco->next_time_us) > nco->period_us) {
+      nco->next_time_us = now_us;
+      nco->period_acc = 0;
+      nco->resyncs++;
+   }
+   return true;
+}
+
+// Returns true if the next event is due. See nco_due_before().
+static inline bool nco_due(nco_t* nco, uint32_t now_us) {
+   return nco_due_before(nco, now_us, now_us);
+}
+
+// Advance to the next event, scheduled from the ideal time of the current event.
+static inline void nco_advance(nco_t* nco) {
+   nco->next_time_us += nco->period_us;
+
+   nco->period_acc += nco->period_frac;
+   if (nco->period_acc < nco->period_frac) // Carry whole microsecond from accumulated fractions
+      nco->next_time_us++;
+}
+
+// Step back to the previous event, exactly undoing nco_advance() (if the period hasn't changed since).
+static inline void nco_rewind(nco_t* nco) {
+   if (nco->period_acc < nco->period_frac) // Undo the whole microsecond carried by nco_advance()
+      nco->next_time_us--;
+
+   nco->period_acc -= nco->period_frac;
+   nco->next_time_us -= nco->period_us;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _PULSE_MATH_H
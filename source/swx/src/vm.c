@@ -0,0 +1,302 @@
+/*
+ * swx
+ * Copyright (C) 2024 saawsm
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "vm.h"
+
+#include "pulse_gen.h"
+#include "trigger.h"
+#include "analog_capture.h"
+
+#define MS_TO_TICKS(ms) (((ms) * 1000u) / VM_TICK_PERIOD_US)
+
+#define OPERAND_U16(op, i) ((op[(i)] << 8) | op[((i) + 1)])
+
+static_assert(CHANNEL_COUNT <= 8); // Ensure 8-bit channel mask operands cover every channel
+
+uint8_t vm_program[VM_PROGRAM_SIZE];
+
+vm_thread_t vm_threads[VM_THREADS];
+
+static uint32_t last_tick_time_us;
+
+typedef struct {
+   uint8_t length;   // Instruction length in bytes, including the opcode.
+   uint8_t reg_mask; // Bitmask of operand bytes that are register indices (bit 1 = first operand byte).
+} op_info_t;
+
+static const op_info_t op_info[TOTAL_VM_OPS] = {
+    [VM_OP_HALT] = {1, 0},
+    [VM_OP_NOP] = {1, 0},
+    [VM_OP_LDI] = {4, (1 << 1)},
+    [VM_OP_MOV] = {3, (1 << 1) | (1 << 2)},
+    [VM_OP_ADD] = {3, (1 << 1) | (1 << 2)},
+    [VM_OP_SUB] = {3, (1 << 1) | (1 << 2)},
+    [VM_OP_ADDI] = {4, (1 << 1)},
+    [VM_OP_SUBI] = {4, (1 << 1)},
+    [VM_OP_JMP] = {3, 0},
+    [VM_OP_JZ] = {4, (1 << 1)},
+    [VM_OP_JNZ] = {4, (1 << 1)},
+    [VM_OP_JLT] = {5, (1 << 1) | (1 << 2)},
+    [VM_OP_DJNZ] = {4, (1 << 1)},
+    [VM_OP_JTRIG] = {5, 0},
+    [VM_OP_JAUDIO] = {5, (1 << 2)},
+    [VM_OP_AUDIO] = {3, (1 << 1)},
+    [VM_OP_WAIT] = {3, 0},
+    [VM_OP_WAITR] = {2, (1 << 1)},
+    [VM_OP_SETP] = {5, (1 << 4)},
+    [VM_OP_GETP] = {5, (1 << 1)},
+    [VM_OP_RAMP] = {6, (1 << 3)},
+    [VM_OP_ENABLE] = {2, 0},
+    [VM_OP_DISABLE] = {2, 0},
+    [VM_OP_EXECUTE] = {3, 0},
+};
+
+void vm_init() {
+   LOG_DEBUG("Init vm...");
+
+   memset(vm_program, 0, sizeof(vm_program));
+   memset(vm_threads, 0, sizeof(vm_threads));
+
+   last_tick_time_us = time_us_32();
+}
+
+bool vm_start(uint8_t thread_index, uint16_t addr) {
+   if (thread_index >= VM_THREADS || addr >= VM_PROGRAM_SIZE)
+      return false;
+
+   vm_thread_t* thread = &vm_threads[thread_index];
+   memset(thread, 0, sizeof(vm_thread_t));
+   thread->pc = addr;
+   thread->state = VM_STATE_RUNNING;
+   return true;
+}
+
+void vm_stop(uint8_t thread_mask) {
+   for (size_t i = 0; i < VM_THREADS; i++) {
+      if (thread_mask & (1 << i))
+         vm_threads[i].state = VM_STATE_STOPPED;
+   }
+}
+
+static inline uint16_t sat_add(uint16_t a, uint16_t b) {
+   const uint32_t value = (uint32_t)a + b;
+   return value > UINT16_MAX ? UINT16_MAX : value;
+}
+
+static inline uint16_t sat_sub(uint16_t a, uint16_t b) {
+   return a > b ? a - b : 0;
+}
+
+static inline void fault(vm_thread_t* thread, size_t thread_index, const char* reason) {
+   LOG_WARN("VM fault! thread=%u pc=%u op=%u (%s)", thread_index, thread->pc, vm_program[thread->pc], reason);
+   thread->state = VM_STATE_FAULT;
+}
+
+// Execute instructions until the thread yields, stops, or the tick budget is consumed. Returns true if generator state was changed.
+static bool thread_run(vm_thread_t* thread, size_t thread_index) {
+   bool changed = false;
+
+   for (uint32_t budget = VM_TICK_BUDGET; budget > 0; budget--) {
+      const uint8_t* const op = &vm_program[thread->pc];
+
+      if (op[0] >= TOTAL_VM_OPS) {
+         fault(thread, thread_index, "invalid opcode");
+         return changed;
+      }
+
+      const uint8_t len = op_info[op[0]].length;
+      if (thread->pc + len > VM_PROGRAM_SIZE) {
+         fault(thread, thread_index, "truncated instruction");
+         return changed;
+      }
+
+      // Validate register operands
+      for (uint8_t i = 1; i < len; i++) {
+         if ((op_info[op[0]].reg_mask & (1 << i)) && op[i] >= VM_REGISTERS) {
+            fault(thread, thread_index, "invalid register");
+            return changed;
+         }
+      }
+
+      uint16_t* const regs = thread->regs;
+      uint16_t next_pc = thread->pc + len;
+
+      switch (op[0]) {
+         case VM_OP_HALT:
+            thread->state = VM_STATE_STOPPED;
+            return changed;
+         case VM_OP_NOP:
+            break;
+         case VM_OP_LDI:
+            regs[op[1]] = OPERAND_U16(op, 2);
+            break;
+         case VM_OP_MOV:
+            regs[op[1]] = regs[op[2]];
+            break;
+         case VM_OP_ADD:
+            regs[op[1]] = sat_add(regs[op[1]], regs[op[2]]);
+            break;
+         case VM_OP_SUB:
+            regs[op[1]] = sat_sub(regs[op[1]], regs[op[2]]);
+            break;
+         case VM_OP_ADDI:
+            regs[op[1]] = sat_add(regs[op[1]], OPERAND_U16(op, 2));
+            break;
+         case VM_OP_SUBI:
+            regs[op[1]] = sat_sub(regs[op[1]], OPERAND_U16(op, 2));
+            break;
+         case VM_OP_JMP:
+            next_pc = OPERAND_U16(op, 1);
+            break;
+         case VM_OP_JZ:
+            if (regs[op[1]] == 0)
+               next_pc = OPERAND_U16(op, 2);
+            break;
+         case VM_OP_JNZ:
+            if (regs[op[1]] != 0)
+               next_pc = OPERAND_U16(op, 2);
+            break;
+         case VM_OP_JLT:
+            if (regs[op[1]] < regs[op[2]])
+               next_pc = OPERAND_U16(op, 3);
+            break;
+         case VM_OP_DJNZ:
+            if (regs[op[1]] > 0)
+               regs[op[1]]--;
+            if (regs[op[1]] != 0)
+               next_pc = OPERAND_U16(op, 2);
+            break;
+         case VM_OP_JTRIG:
+            if ((trig_input_states & op[1]) == op[2])
+               next_pc = OPERAND_U16(op, 3);
+            break;
+         case VM_OP_JAUDIO:
+            if (op[1] < TOTAL_ANALOG_CHANNELS && analog_amplitude(op[1]) >= regs[op[2]])
+               next_pc = OPERAND_U16(op, 3);
+            break;
+         case VM_OP_AUDIO:
+            regs[op[1]] = op[2] < TOTAL_ANALOG_CHANNELS ? analog_amplitude(op[2]) : 0;
+            break;
+         case VM_OP_WAIT:
+         case VM_OP_WAITR: {
+            const uint32_t ms = op[0] == VM_OP_WAIT ? OPERAND_U16(op, 1) : regs[op[1]];
+
+            thread->pc = next_pc;
+            thread->wait_ticks = MS_TO_TICKS(ms);
+            if (thread->wait_ticks) // Zero duration waits yield until the next tick
+               thread->state = VM_STATE_WAITING;
+            return changed;
+         }
+         case VM_OP_SETP:
+            if (op[2] < TOTAL_PARAMS && op[3] < TOTAL_TARGETS) {
+               for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+                  if (op[1] & (1 << ch_index))
+                     config_parameter_set(ch_index, op[2], op[3], regs[op[4]]);
+               }
+               changed = true;
+            }
+            break;
+         case VM_OP_GETP:
+            if (op[2] < CHANNEL_COUNT && op[3] < TOTAL_PARAMS && op[4] < TOTAL_TARGETS)
+               regs[op[1]] = parameter_get(op[2], op[3], op[4]);
+            break;
+         case VM_OP_RAMP:
+            if (op[2] < TOTAL_PARAMS) {
+               const uint16_t duration_ms = OPERAND_U16(op, 4);
+
+               if (pulse_gen_staging()) { // Ramps run on the live generator, so staged writes just take the final value
+                  for (size_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+                     if (op[1] & (1 << ch_index))
+                        config_parameter_set(ch_index, op[2], TARGET_VALUE, regs[op[3]]);
+                  }
+               } else {
+                  parameter_ramp(op[1], op[2], TARGET_VALUE, regs[op[3]], duration_ms);
+               }
+               changed = true;
+
+               // The generator fade does the interpolation, the thread just waits for it to finish
+               thread->pc = next_pc;
+               thread->wait_ticks = MS_TO_TICKS(duration_ms);
+               if (thread->wait_ticks) {
+                  thread->state = VM_STATE_RAMPING;
+                  return changed;
+               }
+            }
+            break;
+         case VM_OP_ENABLE:
+            pulse_gen->en_mask |= op[1];
+            changed = true;
+            break;
+         case VM_OP_DISABLE:
+            pulse_gen->en_mask &= ~op[1];
+            changed = true;
+            break;
+         case VM_OP_EXECUTE:
+            execute_action_list(op[1], op[2]);
+            changed = true;
+            break;
+         default:
+            break;
+      }
+
+      if (next_pc >= VM_PROGRAM_SIZE) {
+         fault(thread, thread_index, "invalid address");
+         return changed;
+      }
+      thread->pc = next_pc;
+   }
+
+   return changed;
+}
+
+// Advance the thread by one tick. Returns true if generator state was changed.
+static bool thread_tick(vm_thread_t* thread, size_t thread_index) {
+   switch (thread->state) {
+      case VM_STATE_WAITING:
+      case VM_STATE_RAMPING:
+         if (--thread->wait_ticks)
+            return false;
+         break;
+      case VM_STATE_RUNNING:
+         break;
+      default:
+         return false;
+   }
+
+   // Wait/ramp completed (or already running), continue executing on this tick
+   thread->state = VM_STATE_RUNNING;
+
+   return thread_run(thread, thread_index);
+}
+
+void vm_process() {
+   const uint32_t now_us = time_us_32();
+   if ((now_us - last_tick_time_us) < VM_TICK_PERIOD_US)
+      return;
+
+   // Keep a fixed tick cadence, but resync instead of bursting ticks after a long stall
+   last_tick_time_us += VM_TICK_PERIOD_US;
+   if ((now_us - last_tick_time_us) >= VM_TICK_PERIOD_US)
+      last_tick_time_us = now_us;
+
+   bool changed = false;
+   for (size_t i = 0; i < VM_THREADS; i++)
+      changed |= thread_tick(&vm_threads[i], i);
+
+   if (changed)
+      pulse_gen_reschedule();
+}
@@ -0,0 +1,58 @@
+/*
+ * swx
+ * Copyright (C) 2024 saawsm
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _VM_H
+#define _VM_H
+
+#include "swx.h"
+#include "bytecode.h"
+#include "channel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+   vm_state_t state; // See vm_state_t.
+   uint16_t pc;      // Address of the next instruction.
+
+   uint16_t regs[VM_REGISTERS];
+
+   uint32_t wait_ticks; // Ticks remaining until a WAIT or RAMP completes.
+} vm_thread_t;
+
+// Shared program memory, see vm_op_t for the instruction encoding.
+extern uint8_t vm_program[VM_PROGRAM_SIZE];
+
+extern vm_thread_t vm_threads[VM_THREADS];
+
+void vm_init();
+
+// Run each thread for at most VM_TICK_BUDGET instructions every VM_TICK_PERIOD_US.
+void vm_process();
+
+// Start a thread at the specified program address. Registers are cleared.
+bool vm_start(uint8_t thread_index, uint16_t addr);
+
+// Stop each thread in the mask (LSB=thread 0).
+void vm_stop(uint8_t thread_mask);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _VM_H
@@ -0,0 +1,206 @@
+/*
+ * swx
+ * Copyright (C) 2024 saawsm
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "util/pulse_math.h"
+
+#include "test.h"
+
+// Compares the parameter derived reads of a generator pass (state times for state_advance(), then the pulse frequency), with the
+// derived_t cache against recomputing them from the parameters every pass. Parameters are written every WRITE_PERIOD passes, or every
+// pass as while a sweep, fade, LFO or modulation route runs. The cache has to be faster in both cases.
+
+#define CHANNEL_COUNT (4)
+#define BENCH_PASSES (1000000)          // Generator passes per measurement, spread over the channels
+#define BENCH_REPEATS (21)              // Measurements per result, the fastest is used since noise only adds time
+#define PASS_PERIOD_US (25)             // Time between passes of a channel
+#define WRITE_PERIOD (1000)             // Passes between parameter writes, when not writing every pass
+#define MAX_FREQ_Q8 ((500 * 10u) << 8) // MAX_FREQUENCY_HZ of pulse_gen.c
+
+// As STATE_SEQUENCE in pulse_gen.c
+static const param_t STATE_SEQUENCE[STATE_COUNT] = {
+    PARAM_ON_RAMP_TIME,
+    PARAM_ON_TIME,
+    PARAM_OFF_RAMP_TIME,
+    PARAM_OFF_TIME,
+};
+
+// As DERIVED_PARAM_BITS in pulse_gen.c
+static const uint8_t DERIVED_PARAM_BITS[TOTAL_PARAMS] = {
+    [PARAM_FREQUENCY] = (1 << DERIVED_FREQ),
+    [PARAM_ON_RAMP_TIME] = (1 << 0),
+    [PARAM_ON_TIME] = (1 << 1),
+    [PARAM_OFF_RAMP_TIME] = (1 << 2),
+    [PARAM_OFF_TIME] = (1 << 3),
+};
+
+typedef struct {
+   uint16_t parameters[TOTAL_PARAMS][TOTAL_TARGETS];
+   uint8_t frequency_frac;
+} bench_channel_t;
+
+typedef struct {
+   uint8_t state_index;
+   uint32_t last_state_time_us;
+   derived_t derived;
+} bench_generator_t;
+
+static bench_channel_t channels[CHANNEL_COUNT];
+static bench_generator_t generators[CHANNEL_COUNT];
+
+static volatile uint32_t bench_sink; // Keeps the results of the benchmarked loops alive
+
+typedef struct {
+   void (*write)(uint8_t ch_index, param_t param, uint16_t value);
+   uint32_t (*pass)(uint8_t ch_index, uint32_t now_us);
+} bench_mode_t;
+
+static void derived_refresh(uint8_t ch_index, uint8_t mask) {
+   derived_update(&generators[ch_index].derived, mask, channels[ch_index].parameters, STATE_SEQUENCE, channels[ch_index].frequency_frac, MAX_FREQ_Q8);
+}
+
+static void write_recompute(uint8_t ch_index, param_t param, uint16_t value) {
+   channels[ch_index].parameters[param][TARGET_VALUE] = value;
+}
+
+// As parameter_set() in pulse_gen.c
+static void write_cached(uint8_t ch_index, param_t param, uint16_t value) {
+   channels[ch_index].parameters[param][TARGET_VALUE] = value;
+
+   if (DERIVED_PARAM_BITS[param])
+      derived_set(&generators[ch_index].derived, __builtin_ctz(DERIVED_PARAM_BITS[param]), value, channels[ch_index].frequency_frac, MAX_FREQ_Q8);
+}
+
+// Returns the end of the current state plus the pulse frequency, so each pass has a result to compare.
+static uint32_t pass_recompute(uint8_t ch_index, uint32_t now_us) {
+   const bench_channel_t* const ch = &channels[ch_index];
+   bench_generator_t* const gen = &generators[ch_index];
+
+   uint32_t state_time_us[STATE_COUNT];
+   for (size_t i = 0; i < STATE_COUNT; i++)
+      state_time_us[i] = ch->parameters[STATE_SEQUENCE[i]][TARGET_VALUE] * 1000u;
+
+   uint32_t state_end_us = 0;
+   if (state_advance(state_time_us, &gen->state_index, &gen->last_state_time_us, now_us))
+      state_end_us = gen->last_state_time_us + state_time_us[gen->state_index];
+
+   return state_end_us + freq_q8_limit(ch->parameters[PARAM_FREQUENCY][TARGET_VALUE], ch->frequency_frac, MAX_FREQ_Q8);
+}
+
+// As derived_get() in pulse_gen.c
+static inline const derived_t* derived_get(uint8_t ch_index) {
+   if (generators[ch_index].derived.frequency_frac != channels[ch_index].frequency_frac)
+      derived_refresh(ch_index, 1 << DERIVED_FREQ);
+   return &generators[ch_index].derived;
+}
+
+// As generator_process() in pulse_gen.c, which reads the derived values once for the state and the pulse frequency.
+static uint32_t pass_cached(uint8_t ch_index, uint32_t now_us) {
+   bench_generator_t* const gen = &generators[ch_index];
+
+   uint32_t state_end_us = 0;
+   const derived_t* const derived = derived_get(ch_index);
+   if (state_advance(derived->state_time_us, &gen->state_index, &gen->last_state_time_us, now_us))
+      state_end_us = gen->last_state_time_us + derived->state_time_us[gen->state_index];
+
+   return state_end_us + derived->freq_q8;
+}
+
+static void channels_init() {
+   srand(1);
+   for (uint8_t ch_index = 0; ch_index < CHANNEL_COUNT; ch_index++) {
+      for (size_t i = 0; i < STATE_COUNT; i++)
+         channels[ch_index].parameters[STATE_SEQUENCE[i]][TARGET_VALUE] = 1 + rand() % 20;
+
+      channels[ch_index].parameters[PARAM_FREQUENCY][TARGET_VALUE] = 1 + rand() % 6000;
+      channels[ch_index].frequency_frac = rand();
+
+      generators[ch_index] = (bench_generator_t){0};
+      derived_refresh(ch_index, DERIVED_ALL);
+   }
+}
+
+static const bench_mode_t MODE_RECOMPUTE = {.write = write_recompute, .pass = pass_recompute};
+static const bench_mode_t MODE_CACHED = {.write = write_cached, .pass = pass_cached};
+
+// Run the passes, writing a parameter every write_period passes. Returns the sum of the pass results.
+static uint32_t passes_run(const bench_mode_t* mode, uint32_t passes, uint32_t write_period) {
+   uint32_t sum = 0;
+   for (uint32_t i = 0; i < passes; i++) {
+      const uint8_t ch_index = i % CHANNEL_COUNT;
+      if (i % write_period == 0)
+         mode->write(ch_index, (i / write_period) & 1 ? PARAM_FREQUENCY : PARAM_ON_TIME, 1 + (i / write_period) % 20);
+
+      sum += mode->pass(ch_index, (i / CHANNEL_COUNT) * PASS_PERIOD_US);
+   }
+   return sum;
+}
+
+// Returns the average time (ns) per pass.
+static double bench_ns(const bench_mode_t* mode, uint32_t write_period) {
+   struct timespec start, end;
+
+   channels_init();
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   bench_sink = passes_run(mode, BENCH_PASSES, write_period);
+   clock_gettime(CLOCK_MONOTONIC, &end);
+
+   return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / BENCH_PASSES;
+}
+
+// Measure both modes alternately, so host load affects them alike. Gives the fastest measurement of each.
+static void bench_compare(uint32_t write_period, double* recompute_ns, double* cached_ns) {
+   for (uint32_t repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+      const double r_ns = bench_ns(&MODE_RECOMPUTE, write_period);
+      const double c_ns = bench_ns(&MODE_CACHED, write_period);
+
+      if (repeat == 0 || r_ns < *recompute_ns)
+         *recompute_ns = r_ns;
+      if (repeat == 0 || c_ns < *cached_ns)
+         *cached_ns = c_ns;
+   }
+}
+
+int main() {
+   // The cache has to give the same results as recomputing, pass for pass
+   static const uint32_t write_periods[] = {1, 7, WRITE_PERIOD};
+   for (size_t i = 0; i < sizeof(write_periods) / sizeof(write_periods[0]); i++) {
+      for (uint32_t passes = 1; passes < 100000; passes *= 3) {
+         channels_init();
+         const uint32_t recompute_sum = passes_run(&MODE_RECOMPUTE, passes, write_periods[i]);
+
+         channels_init();
+         CHECK_EQ(passes_run(&MODE_CACHED, passes, write_periods[i]), recompute_sum);
+      }
+   }
+
+   double recompute_ns, cached_ns, recompute_every_ns, cached_every_ns;
+   bench_compare(WRITE_PERIOD, &recompute_ns, &cached_ns);
+   bench_compare(1, &recompute_every_ns, &cached_every_ns);
+
+   printf("write every %4u passes: recompute %5.2f ns/pass, cached %5.2f ns/pass\n", WRITE_PERIOD, recompute_ns, cached_ns);
+   printf("write every    1 pass:   recompute %5.2f ns/pass, cached %5.2f ns/pass\n", recompute_every_ns, cached_every_ns);
+
+   CHECK(cached_ns <= recompute_ns);
+   CHECK(cached_every_ns <= recompute_every_ns);
+
+   return test_report("bench_derived");
+}
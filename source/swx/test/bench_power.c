@@ -0,0 +1,288 @@
+/*
+ * swx
+ * Copyright (C) 2024 saawsm
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "util/pulse_math.h"
+
+#include "test.h"
+
+// Compares the cost of one power update (generator power level, ramp and audio scaling, then the DAC mapping in output_process_power())
+// between the previous float pipeline and the Q16 pipeline. The RP2040 has no FPU, so the float pipeline is also run with every float
+// operation emulated in integer math (as the compiler does for a core without an FPU). The ROM float routines of the RP2040 are faster
+// than this portable emulation, so the ratio is indicative, not a cycle count of the target.
+
+#define INPUT_COUNT (4096)    // Different inputs per round, so branches aren't perfectly predicted
+#define BENCH_ROUNDS (256)    // Rounds over the inputs per measurement
+#define CAL_OFFSET (400)      // CH_CAL_OFFSET of the SW32 board
+#define DAC_FULL_SCALE (2000) // DAC counts from zero to full power
+
+typedef struct {
+   uint16_t power_level; // Fraction of UINT16_MAX
+   uint16_t cal_value;
+   uint32_t ramp_time_us; // Zero if not ramping
+   uint32_t ramp_phase_inc;
+   uint32_t elapsed_us;
+   bool off_ramp;
+
+   uint16_t amplitude; // Fraction of UINT16_MAX
+   uint16_t max_power; // Fraction of UINT16_MAX
+   float amplitude_f;
+   float max_power_f;
+} power_input_t;
+
+static power_input_t inputs[INPUT_COUNT];
+static uint16_t ramp_table[RAMP_TABLE_SIZE + 1];
+
+static volatile int32_t bench_sink; // Keeps the results of the benchmarked loops alive
+
+// --- Float pipeline, as before the Q16 change ---
+
+static inline float fclamp(float val, float min, float max) {
+   if (val < min) {
+      return min;
+   } else if (val > max) {
+      return max;
+   }
+   return val;
+}
+
+static int16_t power_float(const power_input_t* in) {
+   float power = (float)in->power_level / UINT16_MAX;
+
+   if (in->ramp_time_us) {
+      float state_modifier = (float)in->elapsed_us / in->ramp_time_us;
+      if (state_modifier > 1.0f)
+         state_modifier = 1.0f;
+
+      if (in->off_ramp)
+         state_modifier = 1.0f - state_modifier;
+
+      power *= state_modifier;
+   }
+
+   power *= in->amplitude_f;
+
+   float pwr = fclamp(power, 0.0f, 1.0f) * fclamp(in->max_power_f, 0.0f, 1.0f);
+   return (in->cal_value + CAL_OFFSET) - (DAC_FULL_SCALE * pwr);
+}
+
+// --- Float pipeline with integer float emulation. Round to nearest even, subnormals are flushed to zero (none occur here) ---
+
+typedef uint32_t sf_t; // IEEE 754 single precision bits
+
+#define SF_ONE (0x3f800000u)
+#define SF_SIGN (0x80000000u)
+
+// Value is mant * 2^exp
+static inline uint64_t sf_mant(sf_t a) {
+   return (a & 0x7fffff) | 0x800000;
+}
+
+static inline int32_t sf_exp(sf_t a) {
+   return (int32_t)((a >> 23) & 0xff) - 127 - 23;
+}
+
+// Round the (non-zero) value m * 2^e to the nearest float.
+static sf_t sf_round(uint64_t m, int32_t e) {
+   int32_t shift = (63 - __builtin_clzll(m)) - 23;
+   if (shift > 0) {
+      const uint64_t rem = m & ((1ull << shift) - 1);
+      const uint64_t half = 1ull << (shift - 1);
+
+      m >>= shift;
+      if (rem > half || (rem == half && (m & 1)))
+         m++;
+
+      if (m >> 24) {
+         m >>= 1;
+         shift++;
+      }
+   } else {
+      m <<= -shift;
+   }
+
+   const int32_t biased = e + shift + 23 + 127;
+   if (biased <= 0)
+      return 0;
+   return ((uint32_t)biased << 23) | (m & 0x7fffff);
+}
+
+static sf_t sf_from_u32(uint32_t u) {
+   return u ? sf_round(u, 0) : 0;
+}
+
+static int32_t sf_to_i32(sf_t a) {
+   if ((a & ~SF_SIGN) == 0)
+      return 0;
+
+   const int32_t e = sf_exp(a);
+   const int32_t magnitude = e >= 0 ? (int32_t)(sf_mant(a) << e) : (e > -32 ? (int32_t)(sf_mant(a) >> -e) : 0);
+   return (a & SF_SIGN) ? -magnitude : magnitude;
+}
+
+// Only non-negative operands occur in the pipeline, except for the result of sf_sub().
+static bool sf_lt(sf_t a, sf_t b) {
+   return a < b;
+}
+
+static sf_t sf_mul(sf_t a, sf_t b) {
+   if (a == 0 || b == 0)
+      return 0;
+   return sf_round(sf_mant(a) * sf_mant(b), sf_exp(a) + sf_exp(b));
+}
+
+static sf_t sf_div(sf_t a, sf_t b) {
+   if (a == 0)
+      return 0;
+
+   const uint64_t q = (sf_mant(a) << 40) / sf_mant(b);
+   const bool sticky = (sf_mant(a) << 40) % sf_mant(b) != 0;
+   return sf_round((q << 1) | sticky, sf_exp(a) - sf_exp(b) - 41);
+}
+
+static sf_t sf_sub(sf_t a, sf_t b) {
+   if (a < b)
+      return SF_SIGN | sf_sub(b, a);
+   if (b == 0)
+      return a;
+
+   const int32_t diff = sf_exp(a) - sf_exp(b);
+   if (diff > 40)
+      return a;
+
+   const uint64_t m = (sf_mant(a) << diff) - sf_mant(b);
+   return m ? sf_round(m, sf_exp(b)) : 0;
+}
+
+static inline sf_t sf_clamp(sf_t val, sf_t min, sf_t max) {
+   if (sf_lt(val, min)) {
+      return min;
+   } else if (sf_lt(max, val)) {
+      return max;
+   }
+   return val;
+}
+
+static inline sf_t sf_bits(float f) {
+   union {
+      float f;
+      sf_t bits;
+   } u = {.f = f};
+   return u.bits;
+}
+
+static int16_t power_soft_float(const power_input_t* in) {
+   sf_t power = sf_div(sf_from_u32(in->power_level), sf_from_u32(UINT16_MAX));
+
+   if (in->ramp_time_us) {
+      sf_t state_modifier = sf_div(sf_from_u32(in->elapsed_us), sf_from_u32(in->ramp_time_us));
+      if (sf_lt(SF_ONE, state_modifier))
+         state_modifier = SF_ONE;
+
+      if (in->off_ramp)
+         state_modifier = sf_sub(SF_ONE, state_modifier);
+
+      power = sf_mul(power, state_modifier);
+   }
+
+   power = sf_mul(power, sf_bits(in->amplitude_f));
+
+   sf_t pwr = sf_mul(sf_clamp(power, 0, SF_ONE), sf_clamp(sf_bits(in->max_power_f), 0, SF_ONE));
+   return sf_to_i32(sf_sub(sf_from_u32(in->cal_value + CAL_OFFSET), sf_mul(sf_from_u32(DAC_FULL_SCALE), pwr)));
+}
+
+// --- Q16 pipeline, as in generator_process() and output_process_power() ---
+
+static int16_t power_fixed(const power_input_t* in) {
+   uint16_t power = in->power_level;
+
+   if (in->ramp_time_us)
+      power = q16_mul(power, ramp_envelope(ramp_table, in->ramp_phase_inc, in->off_ramp, in->elapsed_us));
+
+   power = q16_mul(power, in->amplitude);
+
+   uint16_t pwr = q16_mul(power, in->max_power);
+   return (in->cal_value + CAL_OFFSET) - ((DAC_FULL_SCALE * pwr) / UINT16_MAX);
+}
+
+static void inputs_init() {
+   for (size_t i = 0; i <= RAMP_TABLE_SIZE; i++) // Linear ramp, as the float pipeline
+      ramp_table[i] = (i * UINT16_MAX) / RAMP_TABLE_SIZE;
+
+   srand(1);
+   for (size_t i = 0; i < INPUT_COUNT; i++) {
+      power_input_t* const in = &inputs[i];
+
+      in->power_level = rand() & UINT16_MAX;
+      in->cal_value = 1800 + rand() % 400;
+
+      // Half the updates are in a ramp state. The ramp phase increment is whole units per us, so ramps of tens of seconds finish up
+      // to ~1.5% early, which is more than a DAC count near the end of the ramp. Ramps here are limited to 5s.
+      if (rand() & 1) {
+         in->ramp_time_us = (1 + rand() % 5000) * 1000u;
+         in->ramp_phase_inc = phase_inc_us(in->ramp_time_us);
+         in->elapsed_us = rand() % (in->ramp_time_us + 1);
+         in->off_ramp = rand() & 1;
+      }
+
+      in->amplitude = rand() & UINT16_MAX;
+      in->max_power = rand() & UINT16_MAX;
+      in->amplitude_f = (float)in->amplitude / UINT16_MAX;
+      in->max_power_f = (float)in->max_power / UINT16_MAX;
+   }
+}
+
+// Returns the average time (ns) per power update.
+static double bench_ns(int16_t (*power_update)(const power_input_t*)) {
+   struct timespec start, end;
+   int32_t sum = 0;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (uint32_t round = 0; round < BENCH_ROUNDS; round++) {
+      for (size_t i = 0; i < INPUT_COUNT; i++)
+         sum += power_update(&inputs[i]);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+
+   bench_sink = sum;
+   return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / ((double)BENCH_ROUNDS * INPUT_COUNT);
+}
+
+int main() {
+   inputs_init();
+
+   // The emulation has to match the host FPU exactly. The Q16 pipeline rounds the DAC value down rather than truncating the float result,
+   // so it can be a count further from the float pipeline
+   for (size_t i = 0; i < INPUT_COUNT; i++) {
+      CHECK_EQ(power_soft_float(&inputs[i]), power_float(&inputs[i]));
+      CHECK_NEAR(power_fixed(&inputs[i]), power_float(&inputs[i]), 2);
+   }
+
+   const double float_ns = bench_ns(power_float);
+   const double soft_float_ns = bench_ns(power_soft_float);
+   const double fixed_ns = bench_ns(power_fixed);
+
+   printf("float (host FPU):       %6.2f ns/update\n", float_ns);
+   printf("float (emulated):       %6.2f ns/update\n", soft_float_ns);
+   printf("Q16:                    %6.2f ns/update\n", fixed_ns);
+   printf("Q16 vs emulated float:  %6.1fx faster\n", soft_float_ns / fixed_ns);
+
+   return test_report("bench_power");
+}
@@ -0,0 +1,65 @@
+/*
+ * swx
+ * Copyright (C) 2024 saawsm
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _TEST_H
+#define _TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Minimal checks for the host tests. Failures are printed (first few of each check only) and counted, and test_report() sets the exit code.
+
+#define TEST_MAX_REPORTS (10) // Most failures printed, later failures are only counted
+
+static uint32_t test_checks = 0;
+static uint32_t test_failures = 0;
+
+static inline void test_fail(const char* file, int line, const char* expr, int64_t actual, int64_t expected) {
+   if (test_failures++ < TEST_MAX_REPORTS)
+      fprintf(stderr, "%s:%d: check failed: %s (actual=%lld expected=%lld)\n", file, line, expr, (long long)actual, (long long)expected);
+}
+
+#define CHECK(expr)                                         \
+   do {                                                     \
+      test_checks++;                                        \
+      if (!(expr))                                          \
+         test_fail(__FILE__, __LINE__, #expr, false, true); \
+   } while (0)
+
+#define CHECK_EQ(actual, expected)                                         \
+   do {                                                                    \
+      const int64_t a_ = (int64_t)(actual), e_ = (int64_t)(expected);      \
+      test_checks++;                                                       \
+      if (a_ != e_)                                                        \
+         test_fail(__FILE__, __LINE__, #actual " == " #expected, a_, e_); \
+   } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                               \
+   do {                                                                                       \
+      const int64_t a_ = (int64_t)(actual), e_ = (int64_t)(expected);                         \
+      test_checks++;                                                                          \
+      if (a_ - e_ > (tolerance) || e_ - a_ > (tolerance))                                     \
+         test_fail(__FILE__, __LINE__, #actual " ~= " #expected " +/- " #tolerance, a_, e_); \
+   } while (0)
+
+// Print the check counts, returns the process exit code.
+static inline int test_report(const char* name) {
+   printf("%s: %u checks, %u failed\n", name, test_checks, test_failures);
+   return test_failures ? 1 : 0;
+}
+
+#endif // _TEST_H
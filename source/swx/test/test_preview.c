@@ -0,0 +1,252 @@
+/*
+ * swx
+ * Copyright (C) 2024 saawsm
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+
+#include "preview.h"
+#include "util/pulse_math.h"
+
+#include "test.h"
+
+// Checks preview_run() against the pulse timebase (nco_*) and ramp envelope of the generator, and the truncation of long previews.
+
+#define POWER (40000)     // PARAM_POWER value of the previewed channels
+#define PULSE_WIDTH (200) // PARAM_PULSE_WIDTH value of the previewed channels
+
+static preview_event_t events[PREVIEW_MAX_STEPS + 2]; // Room for every step of a preview, plus the first state and power events
+
+// Enabled channel with constant power and width, starting at the beginning of the state with the next pulse due at the start.
+static void channel_init(preview_channel_t* ch, uint32_t freq_q8, uint8_t state_index, const uint32_t state_time_us[TOTAL_PREVIEW_STATES]) {
+   *ch = (preview_channel_t){
+       .freq_q8 = freq_q8,
+       .power = POWER,
+       .power_max = UINT16_MAX,
+       .pulse_width = PULSE_WIDTH,
+       .power_mode = POWER_MODE_DAC,
+       .enabled = true,
+       .state_index = state_index,
+   };
+
+   for (size_t i = 0; i < TOTAL_PREVIEW_STATES; i++)
+      ch->state_time_us[i] = state_time_us[i];
+
+   for (size_t i = 0; i <= RAMP_TABLE_SIZE; i++) // Curved, so an envelope sampled at the wrong phase shows
+      ch->ramp_table[i] = (i * i * UINT16_MAX) / (RAMP_TABLE_SIZE * RAMP_TABLE_SIZE);
+}
+
+// The generator pulse timebase the preview continues from.
+static nco_t pulse_nco(const preview_channel_t* ch) {
+   const uint64_t period_q32 = (10000000ull << 40) / ch->freq_q8;
+
+   return (nco_t){
+       .next_time_us = ch->next_pulse_us,
+       .period_us = period_q32 >> 32,
+       .period_frac = (uint32_t)period_q32,
+       .period_acc = ch->pulse_acc,
+   };
+}
+
+static void test_disabled() {
+   static const uint32_t state_time_us[TOTAL_PREVIEW_STATES] = {0};
+   preview_channel_t ch;
+   channel_init(&ch, 1000 << 8, PREVIEW_STATE_ON, state_time_us);
+   ch.enabled = false;
+
+   uint32_t covered_us = 0;
+   CHECK_EQ(preview_run(&ch, 1000000, events, PREVIEW_MAX_EVENTS, &covered_us), 0);
+   CHECK_EQ(covered_us, 1000000);
+}
+
+// Holding the on state, every pulse is at the next time of the channel timebase, including fractional frequencies.
+static void test_pulse_times() {
+   static const uint32_t state_time_us[TOTAL_PREVIEW_STATES] = {0};
+   static const uint32_t freqs_q8[] = {1000 << 8, (1234 << 8) + 77, (4999 << 8) + 255, (1 << 8) + 3};
+
+   for (size_t i = 0; i < sizeof(freqs_q8) / sizeof(freqs_q8[0]); i++) {
+      preview_channel_t ch;
+      channel_init(&ch, freqs_q8[i], PREVIEW_STATE_ON, state_time_us);
+      ch.next_pulse_us = 150;
+      ch.pulse_acc = 0x80000000u;
+
+      const uint32_t window_us = 100 * ((10000000ull << 8) / ch.freq_q8); // ~100 pulses
+
+      uint32_t covered_us = 0;
+      const size_t count = preview_run(&ch, window_us, events, PREVIEW_MAX_EVENTS, &covered_us);
+      CHECK_EQ(covered_us, window_us);
+      CHECK(count >= 2);
+
+      CHECK_EQ(events[0].time_us, 0);
+      CHECK_EQ(events[0].type, PREVIEW_EVENT_STATE);
+      CHECK_EQ(events[0].value, PREVIEW_STATE_ON);
+
+      CHECK_EQ(events[1].time_us, ch.next_pulse_us);
+      CHECK_EQ(events[1].type, PREVIEW_EVENT_POWER);
+      CHECK_EQ(events[1].value, POWER);
+
+      nco_t nco = pulse_nco(&ch);
+      size_t pulses = 0;
+      for (size_t j = 2; j < count; j++) {
+         CHECK_EQ(events[j].type, PREVIEW_EVENT_PULSE);
+         CHECK_EQ(events[j].value, PULSE_WIDTH);
+         CHECK_EQ(events[j].time_us, nco.next_time_us);
+
+         nco_advance(&nco);
+         pulses++;
+      }
+
+      // Every pulse in the window is there, and the timebase doesn't drift from the exact period
+      CHECK(!deadline_reached(window_us, events[count - 1].time_us));
+      CHECK(deadline_reached(window_us, nco.next_time_us));
+      CHECK_NEAR(events[count - 1].time_us, ch.next_pulse_us + ((pulses - 1) * (10000000ull << 8)) / ch.freq_q8, 1);
+   }
+}
+
+// Pulse power follows the ramp envelope from when each ramp state ideally started, and off states have no pulses.
+static void test_ramp_power() {
+   static const uint32_t state_time_us[TOTAL_PREVIEW_STATES] = {100000, 50000, 80000, 40000};
+
+   preview_channel_t ch;
+   channel_init(&ch, 1000 << 8, PREVIEW_STATE_ON_RAMP, state_time_us);
+   ch.state_elapsed_us = 30000;
+
+   uint32_t covered_us = 0;
+   const size_t count = preview_run(&ch, 500000, events, PREVIEW_MAX_EVENTS, &covered_us);
+   CHECK_EQ(covered_us, 500000);
+
+   uint8_t state = ch.state_index;
+   uint32_t state_start_us = 0u - ch.state_elapsed_us;
+   int32_t power = -1;
+   size_t ramp_pulses = 0;
+
+   for (size_t i = 0; i < count; i++) {
+      const preview_event_t* const event = &events[i];
+
+      switch (event->type) {
+         case PREVIEW_EVENT_STATE:
+            if (i > 0) { // State times are whole, so each state starts when the previous one ideally ended
+               CHECK_EQ(event->time_us, state_start_us + ch.state_time_us[state]);
+               CHECK_EQ(event->value, (state + 1) % TOTAL_PREVIEW_STATES);
+               state_start_us = event->time_us;
+            }
+            state = event->value;
+            break;
+
+         case PREVIEW_EVENT_POWER:
+            power = event->value;
+            break;
+
+         case PREVIEW_EVENT_PULSE: {
+            CHECK(state != PREVIEW_STATE_OFF);
+
+            uint16_t expected = POWER;
+            if (state == PREVIEW_STATE_ON_RAMP || state == PREVIEW_STATE_OFF_RAMP) {
+               const bool off_ramp = state == PREVIEW_STATE_OFF_RAMP;
+               const uint32_t phase_inc = phase_inc_us(ch.state_time_us[state]);
+
+               expected = q16_mul(POWER, ramp_envelope(ch.ramp_table, phase_inc, off_ramp, event->time_us - state_start_us));
+               ramp_pulses++;
+            }
+            CHECK_EQ(power, expected);
+         } break;
+      }
+   }
+   CHECK_EQ(ramp_pulses, 7 + 8 + 10 + 8); // The first ramp started 30ms before the preview
+}
+
+// States with zero duration are skipped without a state event, and don't shift the states after them.
+static void test_skipped_states() {
+   static const uint32_t state_time_us[TOTAL_PREVIEW_STATES] = {0, 10000, 0, 5000};
+
+   preview_channel_t ch;
+   channel_init(&ch, 10000 << 8, PREVIEW_STATE_ON, state_time_us);
+
+   uint32_t covered_us = 0;
+   const size_t count = preview_run(&ch, 100000, events, PREVIEW_MAX_EVENTS, &covered_us);
+   CHECK_EQ(covered_us, 100000);
+
+   size_t states = 0;
+   size_t pulses = 0;
+   for (size_t i = 0; i < count; i++) {
+      if (events[i].type == PREVIEW_EVENT_PULSE) {
+         CHECK_EQ(events[i].time_us % 15000 < 10000, true); // Only during the on state
+         pulses++;
+      } else if (events[i].type == PREVIEW_EVENT_STATE) {
+         CHECK_EQ(events[i].value, states & 1 ? PREVIEW_STATE_OFF : PREVIEW_STATE_ON);
+         CHECK_EQ(events[i].time_us, (states / 2) * 15000 + (states & 1) * 10000);
+         states++;
+      }
+   }
+   CHECK_EQ(states, 13); // On and off states starting before 100ms
+   CHECK_EQ(pulses, 70); // 10 pulses each on state, at 1kHz
+}
+
+// Previews stopped by the event limit cover the window up to the first event that didn't fit.
+static void test_max_events() {
+   static const uint32_t state_time_us[TOTAL_PREVIEW_STATES] = {0};
+
+   preview_channel_t ch;
+   channel_init(&ch, (4000 << 8) + 100, PREVIEW_STATE_ON, state_time_us);
+
+   uint32_t covered_us = 0;
+   size_t count = preview_run(&ch, 10000000, events, PREVIEW_MAX_EVENTS, &covered_us);
+   CHECK_EQ(count, PREVIEW_MAX_EVENTS);
+
+   // The state and power events, then the pulses that fit
+   nco_t nco = pulse_nco(&ch);
+   for (size_t i = 2; i < PREVIEW_MAX_EVENTS; i++)
+      nco_advance(&nco);
+
+   CHECK_EQ(events[PREVIEW_MAX_EVENTS - 1].type, PREVIEW_EVENT_PULSE);
+   CHECK_EQ(covered_us, nco.next_time_us);
+   CHECK(!deadline_reached(covered_us, events[PREVIEW_MAX_EVENTS - 1].time_us));
+
+   // The power event of the first pulse doesn't fit
+   ch.next_pulse_us = 300;
+   count = preview_run(&ch, 10000000, events, 1, &covered_us);
+   CHECK_EQ(count, 1);
+   CHECK_EQ(covered_us, ch.next_pulse_us);
+}
+
+// Previews stopped by the step limit cover the window up to the last simulated step.
+static void test_max_steps() {
+   static const uint32_t state_time_us[TOTAL_PREVIEW_STATES] = {0};
+
+   preview_channel_t ch;
+   channel_init(&ch, 5000 << 8, PREVIEW_STATE_ON, state_time_us);
+
+   uint32_t covered_us = 0;
+   const size_t count = preview_run(&ch, 60000000, events, sizeof(events) / sizeof(events[0]), &covered_us);
+   CHECK_EQ(count, PREVIEW_MAX_STEPS + 2); // A pulse each step, after the state and power events
+
+   nco_t nco = pulse_nco(&ch);
+   for (size_t i = 1; i < PREVIEW_MAX_STEPS; i++)
+      nco_advance(&nco);
+
+   CHECK_EQ(events[count - 1].time_us, nco.next_time_us);
+   CHECK_EQ(covered_us, nco.next_time_us);
+}
+
+int main() {
+   test_disabled();
+   test_pulse_times();
+   test_ramp_power();
+   test_skipped_states();
+   test_max_events();
+   test_max_steps();
+
+   return test_report("preview");
+}
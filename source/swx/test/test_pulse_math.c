@@ -0,0 +1,415 @@
+/*
+ * swx
+ * Copyright (C) 2024 saawsm
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/pulse_math.h"
+
+#include "test.h"
+
+static void test_q16_mul() {
+   CHECK_EQ(q16_mul(UINT16_MAX, UINT16_MAX), UINT16_MAX);
+   CHECK_EQ(q16_mul(0x8000, 0x8000), 0x4000);
+
+   // UINT16_MAX is 1.0, zero is zero, and the result is within 1 of the exact product
+   for (uint32_t a = 0; a <= UINT16_MAX; a++) {
+      CHECK_EQ(q16_mul(a, UINT16_MAX), a);
+      CHECK_EQ(q16_mul(a, 0), 0);
+
+      for (uint32_t b = 0; b <= UINT16_MAX; b += 257) {
+         const int64_t exact = ((uint64_t)a * b) / UINT16_MAX;
+         CHECK_NEAR(q16_mul(a, b), exact, 1);
+      }
+   }
+}
+
+static void test_q16_lerp() {
+   CHECK_EQ(q16_lerp(1000, 60000, 0), 1000);
+   CHECK_EQ(q16_lerp(1000, 60000, 1 << 16), 60000);
+   CHECK_EQ(q16_lerp(60000, 1000, 1 << 16), 1000);
+   CHECK_EQ(q16_lerp(0, UINT16_MAX, 1 << 16), UINT16_MAX);
+   CHECK_EQ(q16_lerp(UINT16_MAX, 0, 1 << 16), 0);
+
+   for (uint32_t t = 0; t <= (1 << 16); t += 64) {
+      const int64_t up = (int64_t)t * UINT16_MAX / (1 << 16);
+      CHECK_NEAR(q16_lerp(0, UINT16_MAX, t), up, 1);
+      CHECK_NEAR(q16_lerp(UINT16_MAX, 0, t), UINT16_MAX - up, 1);
+   }
+}
+
+static void test_table_lerp() {
+   uint16_t ramp_table[RAMP_TABLE_SIZE + 1];
+   for (size_t i = 0; i <= RAMP_TABLE_SIZE; i++)
+      ramp_table[i] = (i * UINT16_MAX) / RAMP_TABLE_SIZE;
+
+   // Table entries are returned exactly, and a linear table interpolates to within 1 of the input
+   for (size_t i = 0; i < RAMP_TABLE_SIZE; i++)
+      CHECK_EQ(table_lerp(ramp_table, RAMP_FRAC_BITS, i << RAMP_FRAC_BITS), ramp_table[i]);
+
+   for (uint32_t x = 0; x <= UINT16_MAX; x++)
+      CHECK_NEAR(table_lerp(ramp_table, RAMP_FRAC_BITS, x), x, 1);
+
+   // Decreasing tables interpolate without wrapping
+   uint16_t power_lut[POWER_LUT_SIZE + 1];
+   for (size_t i = 0; i <= POWER_LUT_SIZE; i++)
+      power_lut[i] = UINT16_MAX - (i * UINT16_MAX) / POWER_LUT_SIZE;
+
+   uint16_t previous = UINT16_MAX;
+   for (uint32_t x = 0; x <= UINT16_MAX; x++) {
+      const uint16_t y = table_lerp(power_lut, POWER_LUT_FRAC_BITS, x);
+      CHECK(y <= previous);
+      previous = y;
+   }
+   CHECK_NEAR(previous, 0, 1);
+}
+
+static void test_ramp_envelope() {
+   uint16_t ramp_table[RAMP_TABLE_SIZE + 1];
+   for (size_t i = 0; i <= RAMP_TABLE_SIZE; i++)
+      ramp_table[i] = (i * UINT16_MAX) / RAMP_TABLE_SIZE;
+
+   const uint32_t ramp_time_us = 250000;
+   const uint32_t phase_inc = phase_inc_us(ramp_time_us);
+
+   // The phase is limited to UINT16_MAX, so the last table entry is approached within 1
+   CHECK_EQ(ramp_envelope(ramp_table, phase_inc, false, 0), 0);
+   CHECK_NEAR(ramp_envelope(ramp_table, phase_inc, false, ramp_time_us), UINT16_MAX, 1);
+   CHECK_NEAR(ramp_envelope(ramp_table, phase_inc, false, ramp_time_us * 10), UINT16_MAX, 1); // Held at the end
+   CHECK_NEAR(ramp_envelope(ramp_table, phase_inc, true, 0), UINT16_MAX, 1);
+   CHECK_EQ(ramp_envelope(ramp_table, phase_inc, true, ramp_time_us), 0);
+
+   // On ramp rises, off ramp falls, both track the elapsed fraction
+   uint16_t previous_on = 0, previous_off = UINT16_MAX;
+   for (uint32_t elapsed_us = 0; elapsed_us <= ramp_time_us; elapsed_us += 100) {
+      const uint16_t on = ramp_envelope(ramp_table, phase_inc, false, elapsed_us);
+      const uint16_t off = ramp_envelope(ramp_table, phase_inc, true, elapsed_us);
+
+      CHECK(on >= previous_on);
+      CHECK(off <= previous_off);
+      CHECK_NEAR(on, ((uint64_t)elapsed_us * UINT16_MAX) / ramp_time_us, 2);
+      previous_on = on;
+      previous_off = off;
+   }
+}
+
+static void test_width_power_scale() {
+   uint16_t power_lut[POWER_LUT_SIZE + 1];
+   for (size_t i = 0; i <= POWER_LUT_SIZE; i++)
+      power_lut[i] = (i * UINT16_MAX) / POWER_LUT_SIZE;
+
+   CHECK_EQ(width_power_scale(power_lut, 200, 40000, 40000), 200); // At the ceiling, the width is unchanged
+   CHECK_EQ(width_power_scale(power_lut, 200, 50000, 40000), 200); // Above the ceiling is limited
+   CHECK_EQ(width_power_scale(power_lut, 200, 0, 40000), 0);
+   CHECK_EQ(width_power_scale(power_lut, 200, 40000, 0), 0); // No ceiling, no pulses
+   CHECK_NEAR(width_power_scale(power_lut, 200, 20000, 40000), 100, 1);
+   CHECK_NEAR(width_power_scale(power_lut, 200, 10000, 40000), 50, 1);
+}
+
+static void test_state_advance() {
+   const uint32_t state_time_us[STATE_COUNT] = {10000, 0, 20000, 0};
+   uint8_t state_index = 0;
+   uint32_t state_start_us = 0;
+
+   CHECK(state_advance(state_time_us, &state_index, &state_start_us, 9999));
+   CHECK_EQ(state_index, 0);
+
+   CHECK(state_advance(state_time_us, &state_index, &state_start_us, 10000)); // Zero duration state is skipped
+   CHECK_EQ(state_index, 2);
+   CHECK_EQ(state_start_us, 10000);
+
+   // Late transitions keep the ideal start time, including through skipped states
+   CHECK(state_advance(state_time_us, &state_index, &state_start_us, 30500));
+   CHECK_EQ(state_index, 0);
+   CHECK_EQ(state_start_us, 30000);
+
+   // Many periods of loop latency don't drift the timebase
+   for (uint32_t cycle = 0; cycle < 1000; cycle++) {
+      const uint32_t cycle_start_us = 30000 + cycle * 30000;
+      CHECK(state_advance(state_time_us, &state_index, &state_start_us, cycle_start_us + 10000 + 700));
+      CHECK(state_advance(state_time_us, &state_index, &state_start_us, cycle_start_us + 30000 + 900));
+   }
+   CHECK_EQ(state_index, 0);
+   CHECK_EQ(state_start_us, 30000 + 1000 * 30000);
+
+   // More than a state behind restarts from now
+   const uint32_t late_us = state_start_us + 10000 + 20001 + 5000;
+   CHECK(state_advance(state_time_us, &state_index, &state_start_us, late_us));
+   CHECK_EQ(state_index, 2);
+   CHECK_EQ(state_start_us, late_us);
+
+   // Every state zero is held
+   const uint32_t zero_time_us[STATE_COUNT] = {0};
+   state_index = 1;
+   CHECK(!state_advance(zero_time_us, &state_index, &state_start_us, 12345));
+   CHECK_EQ(state_index, 1);
+
+   // Timestamps wrap
+   state_index = 0;
+   state_start_us = UINT32_MAX - 4999;
+   CHECK(state_advance(state_time_us, &state_index, &state_start_us, 4999));
+   CHECK_EQ(state_index, 0);
+   CHECK(state_advance(state_time_us, &state_index, &state_start_us, 5000));
+   CHECK_EQ(state_index, 2);
+   CHECK_EQ(state_start_us, 5000);
+}
+
+static void test_deadline() {
+   CHECK(deadline_reached(100, 100));
+   CHECK(!deadline_reached(101, 100));
+   CHECK(deadline_reached(UINT32_MAX - 10, 5)); // Across the wrap
+   CHECK(!deadline_reached(5, UINT32_MAX - 10));
+
+   uint32_t deadline_us = 10;
+   deadline_min(&deadline_us, UINT32_MAX - 10); // Before, across the wrap
+   CHECK_EQ(deadline_us, UINT32_MAX - 10);
+   deadline_min(&deadline_us, 10);
+   CHECK_EQ(deadline_us, UINT32_MAX - 10);
+}
+
+static void test_nco() {
+   // 3 Hz (30 dHz), so every 3 periods is exactly one second
+   nco_t nco = {.next_time_us = UINT32_MAX - 500000}; // Run across the wrap
+   nco_set_period(&nco, (10000000ull << 40) / (30u << 8));
+   CHECK_EQ(nco.period_us, 333333);
+
+   const uint32_t start_us = nco.next_time_us;
+   for (uint32_t i = 1; i <= 3000; i++) {
+      nco_advance(&nco);
+
+      const uint64_t ideal_us = (i * 1000000ull) / 3;
+      CHECK_NEAR(nco.next_time_us - start_us, ideal_us, 1);
+   }
+   CHECK_EQ(nco.next_time_us - start_us, 1000000000u - 1); // The period fraction is truncated, so just short of 1e9
+
+   // Rewinding exactly undoes advancing
+   const nco_t saved = nco;
+   for (uint32_t i = 0; i < 1000; i++)
+      nco_advance(&nco);
+   for (uint32_t i = 0; i < 1000; i++)
+      nco_rewind(&nco);
+   CHECK_EQ(nco.next_time_us, saved.next_time_us);
+   CHECK_EQ(nco.period_acc, saved.period_acc);
+
+   // Period changes are relative to the previous event
+   nco = (nco_t){.next_time_us = 1000, .period_us = 100};
+   nco_set_period(&nco, 250ull << 32);
+   CHECK_EQ(nco.next_time_us, 1150);
+}
+
+static void test_nco_due() {
+   nco_t nco = {.restart = true};
+   nco_set_period(&nco, 1000ull << 32);
+
+   CHECK(nco_due(&nco, 5000)); // Restart is due immediately
+   CHECK_EQ(nco.next_time_us, 5000);
+   nco_advance(&nco);
+
+   CHECK(!nco_due(&nco, 5999));
+   CHECK(nco_due_before(&nco, 5999, 6000)); // Planned ahead up to the horizon
+   CHECK(nco_due(&nco, 6000));
+
+   // Less than a period behind keeps the ideal time
+   CHECK(nco_due(&nco, 6999));
+   CHECK_EQ(nco.next_time_us, 6000);
+   CHECK_EQ(nco.resyncs, 0);
+   nco_advance(&nco);
+
+   // More than a period behind restarts from now instead of bursting
+   CHECK(nco_due(&nco, 10000));
+   CHECK_EQ(nco.next_time_us, 10000);
+   CHECK_EQ(nco.resyncs, 1);
+}
+
+static void test_frac_period() {
+   // Sum of any number of periods is exactly num / den (rounded down)
+   static const struct {
+      uint64_t num;
+      uint32_t den;
+   } periods[] = {{1000000000ull, 7}, {1000000000ull, 3000}, {5000000000ull, 4294836225u}, {1000, 1}, {123456789, 65535}};
+
+   for (size_t i = 0; i < sizeof(periods) / sizeof(periods[0]); i++) {
+      frac_period_t period;
+      frac_period_set(&period, periods[i].num, periods[i].den);
+
+      uint64_t total_us = 0;
+      for (uint64_t k = 1; k <= 200000; k++) {
+         total_us += frac_period_next(&period);
+         CHECK_EQ(total_us, (k * periods[i].num) / periods[i].den);
+      }
+   }
+}
+
+static void test_sweep_period() {
+   frac_period_t period;
+
+   // 1 Hz across 1000 values, one value every 1ms
+   CHECK_EQ(sweep_period_set(&period, 1000, 1000), 1);
+   CHECK_EQ(period.us, 1000);
+   CHECK_EQ(period.rem, 0);
+
+   // 1 mHz across a single value, the slowest sweep
+   CHECK_EQ(sweep_period_set(&period, 1, 1), 1);
+   CHECK_EQ(period.us, 1000000000);
+
+   // ~65 Hz across the full range steps several values at a time, so periods stay over 1us
+   const uint32_t step = sweep_period_set(&period, UINT16_MAX, UINT16_MAX);
+   CHECK_EQ(step, 5);
+   CHECK(period.us >= 1);
+
+   // Average sweep rate is exact
+   uint64_t total_us = 0;
+   for (uint32_t k = 0; k < 1000000; k++)
+      total_us += frac_period_next(&period);
+   CHECK_EQ(total_us, (1000000ull * step * 1000000000ull) / ((uint32_t)UINT16_MAX * UINT16_MAX));
+}
+
+static void test_frac_period_advance() {
+   // Advancing several periods at once lands on the same time as advancing one period at a time
+   static const uint32_t lateness_us[] = {0, 1, 5, 999, 1000, 1001, 12345, 99999};
+
+   frac_period_t period;
+   sweep_period_set(&period, 65000, 3001); // ~5.1us per step
+
+   for (size_t i = 0; i < sizeof(lateness_us) / sizeof(lateness_us[0]); i++) {
+      frac_period_t single = period, multiple = period;
+      uint32_t single_time_us = UINT32_MAX - 1000, multiple_time_us = single_time_us; // Run across the wrap
+      const uint32_t now_us = single_time_us + lateness_us[i];
+
+      uint32_t count = 0;
+      do {
+         single_time_us += frac_period_next(&single);
+         count++;
+      } while (deadline_reached(single_time_us, now_us));
+
+      CHECK_EQ(frac_period_advance(&multiple, &multiple_time_us, now_us), count);
+      CHECK_EQ(multiple_time_us, single_time_us);
+      CHECK_EQ(multiple.acc, single.acc);
+      CHECK(!deadline_reached(multiple_time_us, now_us));
+
+      period = multiple; // Continue from a different fraction
+   }
+}
+
+static void test_sweep_advance() {
+   static const uint8_t modes[] = {TARGET_MODE_UP_DOWN, TARGET_MODE_DOWN_UP, TARGET_MODE_UP_RESET, TARGET_MODE_DOWN_RESET, TARGET_MODE_UP, TARGET_MODE_DOWN};
+
+   // Single steps follow the extent handling of each mode
+   uint16_t value = 98;
+   int8_t step = 1;
+   CHECK_EQ(sweep_advance(&value, &step, 1, 10, 100, TARGET_MODE_UP_DOWN), 0);
+   CHECK_EQ(value, 99);
+   CHECK_EQ(sweep_advance(&value, &step, 1, 10, 100, TARGET_MODE_UP_DOWN), 1); // Reaches max, and turns around
+   CHECK_EQ(value, 100);
+   CHECK_EQ(step, -1);
+   CHECK_EQ(sweep_advance(&value, &step, 1, 10, 100, TARGET_MODE_UP_DOWN), 0);
+   CHECK_EQ(value, 99);
+
+   value = 99, step = 1;
+   CHECK_EQ(sweep_advance(&value, &step, 1, 10, 100, TARGET_MODE_UP_RESET), 1); // Max restarts from min
+   CHECK_EQ(value, 10);
+
+   value = 11, step = -1;
+   CHECK_EQ(sweep_advance(&value, &step, 1, 10, 100, TARGET_MODE_DOWN_RESET), 1); // Min restarts from max
+   CHECK_EQ(value, 100);
+
+   value = 95, step = 1;
+   CHECK_EQ(sweep_advance(&value, &step, 10, 10, 100, TARGET_MODE_UP), 1); // Stops at max
+   CHECK_EQ(value, 100);
+
+   value = 5, step = 1;
+   CHECK_EQ(sweep_advance(&value, &step, 1, 10, 100, TARGET_MODE_UP_DOWN), 0); // Out of range starts from the extent
+   CHECK_EQ(value, 11);
+
+   // Steps past an extent carry over
+   value = 98, step = 2;
+   CHECK_EQ(sweep_advance(&value, &step, 3, 10, 100, TARGET_MODE_UP_DOWN), 1);
+   CHECK_EQ(value, 96);
+   CHECK_EQ(step, -2);
+
+   // Many steps at once end the same as single steps, for every mode (one-shot modes only until they stop)
+   srand(1);
+   for (uint32_t i = 0; i < 20000; i++) {
+      const uint8_t mode = modes[rand() % (sizeof(modes) / sizeof(modes[0]))];
+      const uint16_t min = rand() % 1000;
+      const uint16_t max = min + 1 + rand() % 200;
+      const uint32_t steps = 1 + rand() % 500;
+
+      uint16_t single_value = min + rand() % (max - min + 1), multiple_value = single_value;
+      int8_t single_step = (1 + rand() % 5) * (mode == TARGET_MODE_UP_DOWN || mode == TARGET_MODE_UP_RESET || mode == TARGET_MODE_UP ? 1 : -1);
+      int8_t multiple_step = single_step;
+
+      uint32_t single_ends = 0;
+      for (uint32_t n = 0; n < steps; n++) {
+         single_ends += sweep_advance(&single_value, &single_step, 1, min, max, mode);
+         if (single_ends && (mode == TARGET_MODE_UP || mode == TARGET_MODE_DOWN))
+            break;
+      }
+
+      const uint32_t multiple_ends = sweep_advance(&multiple_value, &multiple_step, steps, min, max, mode);
+      CHECK_EQ(multiple_value, single_value);
+      CHECK_EQ(multiple_step, single_step);
+      CHECK_EQ(multiple_ends, single_ends);
+   }
+}
+
+static void test_fade() {
+   // Fades complete on time, and not more than 1us early for durations up to 65 ms
+   for (uint32_t duration_us = 2; duration_us < 65536; duration_us++) {
+      const uint32_t phase_inc = phase_inc_us(duration_us);
+      CHECK(phase_elapsed(duration_us, phase_inc) >= (1u << 16));
+      CHECK(phase_elapsed(duration_us - 1, phase_inc) < (1u << 16));
+   }
+
+   for (uint32_t duration_ms = 1; duration_ms <= UINT16_MAX; duration_ms += 97) // Protocol durations are 16-bit milliseconds
+      CHECK(phase_elapsed(duration_ms * 1000u, phase_inc_us(duration_ms * 1000u)) >= (1u << 16));
+
+   // Values follow the ideal line, in both directions, ending at the target
+   static const uint16_t fades[][2] = {{1000, 60000}, {60000, 1000}, {0, UINT16_MAX}, {UINT16_MAX, 0}, {500, 501}};
+   for (size_t i = 0; i < sizeof(fades) / sizeof(fades[0]); i++) {
+      const uint16_t from = fades[i][0], to = fades[i][1];
+      const uint32_t duration_us = 250000;
+      const uint32_t phase_inc = phase_inc_us(duration_us);
+
+      for (uint32_t elapsed_us = 0; elapsed_us <= duration_us; elapsed_us += 1000) {
+         const uint32_t phase = phase_elapsed(elapsed_us, phase_inc);
+         const uint16_t value = phase < (1u << 16) ? q16_lerp(from, to, phase) : to;
+
+         const int64_t ideal = from + (((int64_t)to - from) * elapsed_us) / (int64_t)duration_us;
+         CHECK_NEAR(value, ideal, 2);
+      }
+   }
+}
+
+int main() {
+   test_q16_mul();
+   test_q16_lerp();
+   test_table_lerp();
+   test_ramp_envelope();
+   test_width_power_scale();
+   test_state_advance();
+   test_deadline();
+   test_nco();
+   test_nco_due();
+   test_frac_period();
+   test_sweep_period();
+   test_frac_period_advance();
+   test_sweep_advance();
+   test_fade();
+
+   return test_report("pulse_math");
+}
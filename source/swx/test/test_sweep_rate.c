@@ -0,0 +1,108 @@
+/*
+ * swx
+ * Copyright (C) 2024 saawsm
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/pulse_math.h"
+
+#include "test.h"
+
+// Sweeps a parameter the way parameter_step() does, from 1 mHz to ~65 Hz, and reports the rate error against TARGET_RATE.
+// Passes run at least PASS_PERIOD_US apart (with jitter), so fast sweeps need several steps per pass to keep up.
+
+#define PASS_PERIOD_US (1000) // Typical time between generator passes while busy
+#define PASS_JITTER_US (200)  // Extra latency of each pass
+#define MIN_TRAVEL (100000)   // Values swept before measuring, so the last partial step doesn't matter
+#define MAX_PASSES (200000)   // Bounds the simulation time of slow sweeps
+
+typedef struct {
+   uint16_t min;
+   uint16_t max;
+   uint8_t mode;
+} sweep_t;
+
+// Returns the rate error (ppm) of sweeping at the rate (mHz), measured over the distance travelled.
+static double sweep_rate_error(const sweep_t* sweep, uint16_t rate) {
+   frac_period_t period;
+   const uint32_t range = sweep->max - sweep->min;
+
+   int8_t step = sweep_period_set(&period, rate, range);
+   uint16_t value = sweep->min;
+
+   const uint32_t start_us = UINT32_MAX - 5000000; // Run across the timer wrap
+   uint32_t now_us = start_us;
+   uint32_t next_time_us = start_us + period.us;
+   uint64_t ends = 0;
+
+   // Long enough to travel MIN_TRAVEL values, or as many passes as allowed
+   const uint64_t duration_us = (MIN_TRAVEL * 1000000000ull) / ((uint64_t)rate * range);
+   uint64_t elapsed_us = 0;
+
+   srand(rate);
+   for (uint32_t pass = 0; pass < MAX_PASSES && elapsed_us < duration_us; pass++) {
+      // The scheduler wakes the generator at the next step deadline, but never sooner than a pass after the last one
+      const uint32_t wake_us = deadline_reached(next_time_us, now_us + PASS_PERIOD_US) ? now_us + PASS_PERIOD_US : next_time_us;
+      const uint32_t pass_us = wake_us + rand() % PASS_JITTER_US;
+
+      elapsed_us += pass_us - now_us; // Timestamps wrap every ~71 minutes, slow sweeps run for longer
+      now_us = pass_us;
+
+      if (!deadline_reached(next_time_us, now_us))
+         continue;
+
+      const uint32_t steps = frac_period_advance(&period, &next_time_us, now_us);
+      ends += sweep_advance(&value, &step, steps, sweep->min, sweep->max, sweep->mode);
+   }
+
+   // Distance travelled, UP_DOWN covers the range between each extent, UP_RESET covers the range between each restart
+   const uint64_t position = sweep->mode == TARGET_MODE_UP_DOWN && step < 0 ? sweep->max - value : value - sweep->min;
+   const double travelled = (double)ends * range + position;
+   const double expected = ((double)elapsed_us * rate * range) / 1e9;
+
+   // Every step period that elapsed has been applied, however late the pass, so the sweep is within a step of the ideal
+   const double error_ppm = ((travelled - expected) / expected) * 1e6;
+
+   printf("%s %5u..%-5u rate=%5u mHz: travelled=%12.0f expected=%14.1f error=%+10.1f ppm\n", sweep->mode == TARGET_MODE_UP_DOWN ? "UP_DOWN " : "UP_RESET",
+          sweep->min, sweep->max, rate, travelled, expected, error_ppm);
+
+   CHECK_NEAR(travelled, expected, abs(step) + 1);
+   return error_ppm;
+}
+
+int main() {
+   static const sweep_t sweeps[] = {
+       {.min = 0, .max = 1, .mode = TARGET_MODE_UP_DOWN},
+       {.min = 100, .max = 400, .mode = TARGET_MODE_UP_DOWN},
+       {.min = 0, .max = UINT16_MAX, .mode = TARGET_MODE_UP_DOWN},
+       {.min = 100, .max = 400, .mode = TARGET_MODE_UP_RESET},
+       {.min = 0, .max = UINT16_MAX, .mode = TARGET_MODE_UP_RESET},
+   };
+   static const uint16_t rates[] = {1, 10, 100, 1000, 5000, 10000, 20000, 40000, 65535};
+
+   double worst_ppm = 0;
+   for (size_t i = 0; i < sizeof(sweeps) / sizeof(sweeps[0]); i++) {
+      for (size_t j = 0; j < sizeof(rates) / sizeof(rates[0]); j++) {
+         const double error_ppm = sweep_rate_error(&sweeps[i], rates[j]);
+         if (error_ppm > worst_ppm || -error_ppm > worst_ppm)
+            worst_ppm = error_ppm < 0 ? -error_ppm : error_ppm;
+      }
+   }
+   printf("worst rate error: %.1f ppm\n", worst_ppm);
+
+   return test_report("sweep_rate");
+}